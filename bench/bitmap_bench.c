@@ -0,0 +1,135 @@
+/*
+ *  bench/bitmap_bench.c
+ *
+ *  (C) 2021  Jacky
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "kernel/bitmap.h"
+
+/* 位图字节数，32K位相当于128M的物理内存池 */
+#define BENCH_BITMAP_LEN   4096
+/* 每组测试的轮数 */
+#define BENCH_ROUNDS       200
+/* 每轮连续分配的次数 */
+#define BENCH_BATCH        64
+
+void panic(const char *fileName, uint32_t fileLine, const char *funcName, const char *condition)
+{
+    fprintf(stderr, "panic: %s:%u %s: %s\n", fileName, fileLine, funcName, condition);
+    exit(1);
+}
+
+/* 原逐位扫描实现，作为对比基准 */
+static bool BenchBitUsed(Bitmap *bitmap, uint32_t k)
+{
+    return (bitmap->bitmap[k / 8] & (1 << (k % 8))) != 0;
+}
+
+static int32_t BenchScanLegacy(Bitmap *bitmap, uint32_t n)
+{
+    for (uint32_t i = 0; i + n < ((bitmap->bitmapLen + 1) * 8); i++) {
+        uint32_t cnt = 0;
+        while (BenchBitUsed(bitmap, i + cnt) == false) {
+            cnt++;
+            if (cnt >= n) {
+                return i;
+            }
+        }
+        i += cnt;
+    }
+
+    return -1;
+}
+
+static uint64_t BenchNowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* 模拟内存池使用了fillPercent后的位图：低端连续占用，其中夹杂少量已释放的空洞 */
+static void BenchFill(Bitmap *bitmap, uint32_t fillPercent)
+{
+    uint32_t usedBits = bitmap->bitmapLen * 8 / 100 * fillPercent;
+
+    BitmapInit(bitmap);
+    BitmapSetRange(bitmap, 0, usedBits, 1);
+    srand(20210515);
+    for (uint32_t i = 0; i < usedBits / 50; i++) {
+        BitmapSet(bitmap, rand() % usedBits, 0);
+    }
+}
+
+typedef int32_t (*BenchScanFunc)(Bitmap *bitmap, uint32_t n);
+
+/* 模拟Mem_Palloc/Mem_FreePhyAddr：每轮连续分配BENCH_BATCH次n位，再全部释放，返回每次扫描的平均纳秒数 */
+static double BenchRun(Bitmap *bitmap, uint32_t n, BenchScanFunc scan)
+{
+    int32_t index[BENCH_BATCH];
+    uint64_t start = BenchNowNs();
+    for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+        for (uint32_t k = 0; k < BENCH_BATCH; k++) {
+            index[k] = scan(bitmap, n);
+            if (index[k] != -1) {
+                BitmapSetRange(bitmap, index[k], n, 1);
+            }
+        }
+
+        for (uint32_t k = BENCH_BATCH; k > 0; k--) {
+            if (index[k - 1] != -1) {
+                BitmapSetRange(bitmap, index[k - 1], n, 0);
+            }
+        }
+    }
+
+    return (double)(BenchNowNs() - start) / (BENCH_ROUNDS * BENCH_BATCH);
+}
+
+/* 校验新旧实现在同一位图状态下返回相同的起始位 */
+static uint32_t BenchVerify(Bitmap *bitmap, uint32_t n)
+{
+    uint32_t mismatch = 0;
+    for (uint32_t k = 0; k < BENCH_BATCH; k++) {
+        int32_t expect = BenchScanLegacy(bitmap, n);
+        int32_t index = BitmapScan(bitmap, n);
+        if (expect != index) {
+            mismatch++;
+        }
+        if (index == -1) {
+            break;
+        }
+        BitmapSetRange(bitmap, index, n, 1);
+    }
+
+    return mismatch;
+}
+
+int main(void)
+{
+    static uint8_t bits[BENCH_BITMAP_LEN + 1];
+    Bitmap bitmap = { BENCH_BITMAP_LEN, bits, 0 };
+    const uint32_t fills[] = { 10, 50, 95 };
+    const uint32_t runs[] = { 1, 8 };
+
+    printf("%-6s %-4s %14s %14s %9s\n", "fill", "n", "legacy ns/op", "word ns/op", "speedup");
+    for (uint32_t i = 0; i < sizeof(fills) / sizeof(fills[0]); i++) {
+        for (uint32_t j = 0; j < sizeof(runs) / sizeof(runs[0]); j++) {
+            BenchFill(&bitmap, fills[i]);
+            double legacyNs = BenchRun(&bitmap, runs[j], BenchScanLegacy);
+            BenchFill(&bitmap, fills[i]);
+            double wordNs = BenchRun(&bitmap, runs[j], BitmapScan);
+            BenchFill(&bitmap, fills[i]);
+            uint32_t mismatch = BenchVerify(&bitmap, runs[j]);
+
+            printf("%3u%%   %-4u %14.1f %14.1f %8.1fx%s\n", fills[i], runs[j], legacyNs, wordNs,
+                   legacyNs / wordNs, mismatch ? "  (MISMATCH)" : "");
+        }
+    }
+
+    return 0;
+}
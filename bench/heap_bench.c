@@ -0,0 +1,355 @@
+/*
+ *  bench/heap_bench.c
+ *
+ *  (C) 2021  Jacky
+ */
+
+/* 内核的pid_t与主机sys/types.h中的定义冲突，引入内核头文件时改名 */
+#define pid_t kernel_pid_t
+#include "kernel/memory.h"
+#include "kernel/thread.h"
+#include "kernel/interrupt.h"
+#include "kernel/panic.h"
+#undef pid_t
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* 模拟物理内存池的页数，64M */
+#define BENCH_POOL_PAGES   16384
+/* 模拟页分配记录的最大条数 */
+#define BENCH_MAP_MAX      BENCH_POOL_PAGES
+/* 每条轨迹同时存活的最大对象数 */
+#define BENCH_LIVE_MAX     4096
+/* 每条轨迹的操作轮数 */
+#define BENCH_ROUNDS       200000
+/* fork轨迹中的子进程个数 */
+#define BENCH_FORKS        64
+/* 最小申请字节数，64位主机上空闲块链表节点超过16字节，放不进最小规格，跳过该规格 */
+#define BENCH_MIN_SIZE     ((sizeof(MemBlock) > 16) ? 17 : 1)
+
+/* 模拟页分配记录，进程退出时按所属任务整体回收 */
+typedef struct {
+    void *addr;
+    uint32_t pageCnt;
+    Task *owner;
+} BenchMap;
+
+/* 存活对象，内容填充为tag用于检查重叠 */
+typedef struct {
+    uint8_t *addr;
+    uint32_t size;
+    uint8_t tag;
+} BenchObj;
+
+static BenchMap g_benchMaps[BENCH_MAP_MAX];
+static uint32_t g_benchMapCnt;
+static uint32_t g_benchPages;
+static uint32_t g_benchPeakPages;
+
+static BenchObj g_benchObjs[BENCH_LIVE_MAX];
+static uint32_t g_benchObjCnt;
+static uint64_t g_benchLiveBytes;
+
+static Task g_benchKernelTask;
+static Task *g_benchRunning = &g_benchKernelTask;
+static uint32_t g_benchSeed = 1;
+
+void panic(const char *fileName, uint32_t fileLine, const char *funcName, const char *condition)
+{
+    fprintf(stderr, "panic: %s:%u %s: %s\n", fileName, fileLine, funcName, condition);
+    exit(1);
+}
+
+/* 以下为堆分配器依赖的内核接口，在主机上用单线程模拟 */
+Task *Thread_GetRunningTask(void)
+{
+    return g_benchRunning;
+}
+
+IntrStatus Idt_IntrDisable(void)
+{
+    return INTR_OFF;
+}
+
+void Idt_SetIntrStatus(IntrStatus status)
+{
+    (void)status;
+}
+
+void Mem_PoolLock(VirMemType type)
+{
+    (void)type;
+}
+
+void Mem_PoolUnLock(VirMemType type)
+{
+    (void)type;
+}
+
+uint32_t Mem_TotalPages(void)
+{
+    return BENCH_POOL_PAGES;
+}
+
+void put_str(const char *str)
+{
+    fputs(str, stdout);
+}
+
+void put_int(int32_t num)
+{
+    printf("%x", num);
+}
+
+void *Mem_MallocPages(VirMemType virMemType, uint32_t pageNum)
+{
+    (void)virMemType;
+    if ((g_benchPages + pageNum > BENCH_POOL_PAGES) || (g_benchMapCnt == BENCH_MAP_MAX)) {
+        return NULL;
+    }
+
+    void *addr = aligned_alloc(PAGE_SIZE, pageNum * PAGE_SIZE);
+    if (addr == NULL) {
+        return NULL;
+    }
+
+    g_benchMaps[g_benchMapCnt].addr = addr;
+    g_benchMaps[g_benchMapCnt].pageCnt = pageNum;
+    g_benchMaps[g_benchMapCnt].owner = g_benchRunning;
+    g_benchMapCnt++;
+    g_benchPages += pageNum;
+    if (g_benchPages > g_benchPeakPages) {
+        g_benchPeakPages = g_benchPages;
+    }
+
+    return addr;
+}
+
+static void BenchUnmap(uint32_t idx)
+{
+    g_benchPages -= g_benchMaps[idx].pageCnt;
+    free(g_benchMaps[idx].addr);
+    g_benchMaps[idx] = g_benchMaps[--g_benchMapCnt];
+}
+
+void Mem_Free(VirMemType type, void *virAddr, uint32_t n)
+{
+    (void)type;
+    for (uint32_t i = 0; i < g_benchMapCnt; i++) {
+        if (g_benchMaps[i].addr == virAddr) {
+            ASSERT(g_benchMaps[i].pageCnt == n);
+            BenchUnmap(i);
+            return;
+        }
+    }
+
+    ASSERT(!"free unmapped page");
+}
+
+static uint32_t BenchRand(void)
+{
+    g_benchSeed = g_benchSeed * 1103515245 + 12345;
+    return (g_benchSeed >> 16) & 0x7fff;
+}
+
+static uint64_t BenchNowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* 初始化一个模拟任务，pgDir非空表示用户进程 */
+static void BenchTaskInit(Task *task, bool user)
+{
+    task->pgDir = user ? (uint32_t *)task : NULL;
+    Mem_BlockDescInit(task->memblockDesc);
+    Mem_MagazineInit(task->magazines);
+}
+
+/* 申请size字节并记录为存活对象 */
+static void BenchAlloc(uint32_t size)
+{
+    ASSERT(g_benchObjCnt < BENCH_LIVE_MAX);
+    if (size < BENCH_MIN_SIZE) {
+        size = BENCH_MIN_SIZE;
+    }
+    uint8_t *addr = sys_malloc(size);
+    ASSERT(addr != NULL);
+
+    uint8_t tag = (uint8_t)BenchRand();
+    for (uint32_t i = 0; i < size; i++) {
+        addr[i] = tag;
+    }
+
+    g_benchObjs[g_benchObjCnt].addr = addr;
+    g_benchObjs[g_benchObjCnt].size = size;
+    g_benchObjs[g_benchObjCnt].tag = tag;
+    g_benchObjCnt++;
+    g_benchLiveBytes += size;
+}
+
+/* 检查对象内容没有被其他对象覆盖后释放 */
+static void BenchFree(uint32_t idx)
+{
+    BenchObj *obj = &g_benchObjs[idx];
+    for (uint32_t i = 0; i < obj->size; i++) {
+        ASSERT(obj->addr[i] == obj->tag);
+    }
+
+    sys_free(obj->addr);
+    g_benchLiveBytes -= obj->size;
+    g_benchObjs[idx] = g_benchObjs[--g_benchObjCnt];
+}
+
+static void BenchFreeAll(void)
+{
+    while (g_benchObjCnt > 0) {
+        BenchFree(g_benchObjCnt - 1);
+    }
+}
+
+/* 打印一条轨迹的结果，碎片率按存活字节数与占用页的比例计算 */
+static void BenchReport(const char *name, uint64_t ops, uint64_t ns, uint32_t fragPages, uint64_t fragBytes)
+{
+    double frag = (fragPages == 0) ? 0.0 : 1.0 - (double)fragBytes / ((double)fragPages * PAGE_SIZE);
+    uint32_t leftPages = g_benchPages;
+    uint32_t reclaimed = Mem_Reclaim(VIR_MEM_KERNEL);
+
+    printf("%-10s %8.2f Mops/s  frag %5.1f%%  peak %5u pages  left %4u pages  reclaim %4u pages\n",
+           name, (double)ops * 1000.0 / (double)ns, frag * 100.0, g_benchPeakPages, leftPages, reclaimed);
+}
+
+/* 文件系统轨迹：扇区缓冲、目录项缓冲和多页块缓冲按先进先出的窗口申请释放 */
+static void BenchTraceFs(void)
+{
+    static const uint32_t sizes[] = { 512, 560, 512, 2 * PAGE_SIZE, 512, 1024 };
+    const uint32_t window = 64;
+    uint32_t fragPages = 0;
+    uint64_t fragBytes = 0;
+    uint64_t ops = 0;
+
+    g_benchPeakPages = g_benchPages;
+    uint64_t start = BenchNowNs();
+    for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+        BenchAlloc(sizes[round % (sizeof(sizes) / sizeof(sizes[0]))]);
+        ops++;
+        if (g_benchObjCnt > window) {
+            /* 释放最早申请的缓冲 */
+            BenchFree(0);
+            ops++;
+        }
+        if (g_benchPages >= fragPages) {
+            fragPages = g_benchPages;
+            fragBytes = g_benchLiveBytes;
+        }
+    }
+    BenchFreeAll();
+    uint64_t ns = BenchNowNs() - start;
+
+    BenchReport("fs", ops, ns, fragPages, fragBytes);
+}
+
+/* fork轨迹：父进程持有长期对象，子进程使用新的描述符和弹匣，短暂分配后整体退出 */
+static void BenchTraceFork(void)
+{
+    static Task parent;
+    static Task child;
+    uint32_t fragPages = 0;
+    uint64_t fragBytes = 0;
+    uint64_t ops = 0;
+
+    BenchTaskInit(&parent, true);
+    g_benchRunning = &parent;
+    g_benchPeakPages = g_benchPages;
+
+    uint64_t start = BenchNowNs();
+    for (uint32_t fork = 0; fork < BENCH_FORKS; fork++) {
+        g_benchRunning = &parent;
+        for (uint32_t i = 0; i < 32; i++) {
+            BenchAlloc(16 << (BenchRand() % 5));
+            ops++;
+        }
+
+        /* 子进程的对象不加入父进程的存活表，退出时随地址空间一起释放 */
+        uint32_t parentObjCnt = g_benchObjCnt;
+        uint64_t parentLiveBytes = g_benchLiveBytes;
+        BenchTaskInit(&child, true);
+        g_benchRunning = &child;
+        for (uint32_t round = 0; round < BENCH_ROUNDS / BENCH_FORKS; round++) {
+            if ((g_benchObjCnt > parentObjCnt) && (BenchRand() % 2 == 0)) {
+                BenchFree(parentObjCnt + BenchRand() % (g_benchObjCnt - parentObjCnt));
+            } else if (g_benchObjCnt < BENCH_LIVE_MAX) {
+                BenchAlloc(8 + BenchRand() % 1024);
+            }
+            ops++;
+            if (g_benchPages >= fragPages) {
+                fragPages = g_benchPages;
+                fragBytes = g_benchLiveBytes;
+            }
+        }
+
+        /* 子进程退出，模拟Mem_ReleaseUserSpace回收其全部页 */
+        for (uint32_t i = g_benchMapCnt; i > 0; i--) {
+            if (g_benchMaps[i - 1].owner == &child) {
+                BenchUnmap(i - 1);
+            }
+        }
+        g_benchObjCnt = parentObjCnt;
+        g_benchLiveBytes = parentLiveBytes;
+    }
+
+    g_benchRunning = &parent;
+    BenchFreeAll();
+    uint64_t ns = BenchNowNs() - start;
+
+    BenchReport("fork", ops, ns, fragPages, fragBytes);
+    printf("%-10s parent heap reclaim %u pages\n", "", Mem_Reclaim(VIR_MEM_USER));
+    g_benchRunning = &g_benchKernelTask;
+}
+
+/* 小对象轨迹：大量8~1024字节的随机对象，申请和释放随机交错 */
+static void BenchTraceSmall(void)
+{
+    uint32_t fragPages = 0;
+    uint64_t fragBytes = 0;
+    uint64_t ops = 0;
+
+    g_benchPeakPages = g_benchPages;
+    uint64_t start = BenchNowNs();
+    for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+        /* 前半程偏向申请，后半程偏向释放 */
+        uint32_t allocPercent = (round < BENCH_ROUNDS / 2) ? 60 : 40;
+        if ((g_benchObjCnt < BENCH_LIVE_MAX) && ((g_benchObjCnt == 0) || (BenchRand() % 100 < allocPercent))) {
+            BenchAlloc(8 + BenchRand() % 1017);
+        } else {
+            BenchFree(BenchRand() % g_benchObjCnt);
+        }
+        ops++;
+        if (g_benchPages >= fragPages) {
+            fragPages = g_benchPages;
+            fragBytes = g_benchLiveBytes;
+        }
+    }
+    BenchFreeAll();
+    uint64_t ns = BenchNowNs() - start;
+
+    BenchReport("small", ops, ns, fragPages, fragBytes);
+}
+
+int main(void)
+{
+    BenchTaskInit(&g_benchKernelTask, false);
+    Mem_HeapInit();
+
+    BenchTraceFs();
+    BenchTraceSmall();
+    BenchTraceFork();
+
+    printf("pages in use at exit: %u\n", g_benchPages);
+    Mem_HeapPrint();
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+/*
+ *  bench/include/stdint.h
+ *
+ *  (C) 2021  Jacky
+ */
+#ifndef BENCH_STDINT_H
+#define BENCH_STDINT_H
+
+/* 主机侧编译内核源码时使用系统的定长整型，仅补充内核stdint.h中的bool与NULL定义 */
+#include_next <stdint.h>
+
+typedef enum {
+    false = 0,
+    true = 1
+} bool;
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+#endif
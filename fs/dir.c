@@ -27,9 +27,9 @@ void Dir_OpenRootDir(Partition *part)
 /* 打开目录 */
 Dir *Dir_Open(Partition *part, uint32_t inodeNo)
 {
-    Dir *dir = (Dir *)sys_malloc(sizeof(Dir));
+    Dir *dir = (Dir *)Slab_Alloc(g_dirCache);
     if (dir == NULL) {
-        PANIC("sys_malloc failed!!!");
+        PANIC("Slab_Alloc failed!!!");
         return NULL;
     }
 
@@ -48,7 +48,7 @@ void Dir_Close(Dir *dir)
     }
 
     Inode_Close(dir->inode);
-    sys_free(dir);
+    Slab_Free(g_dirCache, dir);
 
     return;
 }
@@ -406,7 +406,7 @@ int32_t Dir_Remove(Dir *parentDir, Dir *chileDir)
         blockIndex++;
     }
 
-    void *ioBuf = sys_malloc(SECTOR_PER_SIZE * 2);
+    void *ioBuf = Slab_Alloc(g_ioBufCache);
     if (ioBuf == NULL) {
         Console_PutStr("dir_remove: malloc for ioBuf failed\n");
         return -1;
@@ -416,7 +416,7 @@ int32_t Dir_Remove(Dir *parentDir, Dir *chileDir)
     Dir_DeleteDirEntry(g_curPartition, parentDir, childDirInode->iNo, ioBuf);
 
     Inode_Release(g_curPartition, childDirInode->iNo);
-    sys_free(ioBuf);
+    Slab_Free(g_ioBufCache, ioBuf);
 
     return 0;
 }
@@ -60,9 +60,9 @@ int32_t File_AllocBlockInBlockBitmap(Partition *part)
 int32_t File_Create(Dir *parentDir, char *fileName, uint8_t flag)
 {
     /* 由于后面会更改系统的bitmap，有可能造成文件创建失败的动作都应该在前面完成 */
-    uint8_t *ioBuf = sys_malloc(1024);
+    uint8_t *ioBuf = Slab_Alloc(g_ioBufCache);
     if (ioBuf == NULL) {
-        Console_PutStr("sys_malloc failed!!!");
+        Console_PutStr("Slab_Alloc failed!!!");
         return -1;
     }
 
@@ -75,10 +75,10 @@ int32_t File_Create(Dir *parentDir, char *fileName, uint8_t flag)
         goto rollback;
     }
 
-    /* 需要从堆上申请内存，因为inode要存放在全局数组中 */
-    Inode *newFileInode = (Inode *)sys_malloc(sizeof(Inode));
+    /* inode要存放在全局数组中被所有任务共享，从内核对象缓存中分配 */
+    Inode *newFileInode = (Inode *)Slab_Alloc(g_inodeCache);
     if (newFileInode == NULL) {
-        Console_PutStr("sys_malloc failed!!!");
+        Console_PutStr("Slab_Alloc failed!!!");
         rollbackStep = 1;
         /* 组员回滚 */
         goto rollback;
@@ -113,22 +113,22 @@ int32_t File_Create(Dir *parentDir, char *fileName, uint8_t flag)
     }
 
     /* 2. 将父目录i结点的内容同步到有硬盘 */
-    memset(ioBuf, 0, 1024);
+    memset(ioBuf, 0, FS_IO_BUF_SIZE);
     Inode_Write(g_curPartition, parentDir->inode, ioBuf);
 
     /* 3. 将创建文件的i结点同步到硬盘 */
-    memset(ioBuf, 0, 1024);
+    memset(ioBuf, 0, FS_IO_BUF_SIZE);
     Inode_Write(g_curPartition, newFileInode, ioBuf);
 
     /* 4. 位图同步到硬盘 */
-    memset(ioBuf, 0, 1024);
+    memset(ioBuf, 0, FS_IO_BUF_SIZE);
     File_BitmapSync(g_curPartition, inodeNo, INODE_BITMAP);
 
     /* 5. 将创建的文件i结点添加在openInodes链表中 */
     List_Push(&g_curPartition->openInodes, &newFileInode->inodeTag);
     newFileInode->iOpenCnts = 1;
 
-    sys_free(ioBuf);
+    Slab_Free(g_ioBufCache, ioBuf);
 
     return File_AddFdToTask(newFileInode->iNo);
 
@@ -139,14 +139,14 @@ rollback:
         memset(&g_fileTable[fdIndex], 0, sizeof(File));
 
     case 2:
-        sys_free(newFileInode);
+        Slab_Free(g_inodeCache, newFileInode);
 
     case 1:
         BitmapSet(&g_curPartition->inodeBitmap, inodeNo, 0);
         break;
     }
 
-    sys_free(ioBuf);
+    Slab_Free(g_ioBufCache, ioBuf);
     return -1;
 }
 
@@ -14,10 +14,15 @@
 #include "kernel/device/ide.h"
 #include "kernel/console.h"
 #include "kernel/memory.h"
+#include "kernel/swap.h"
 #include "lib/string.h"
 
 Partition *g_curPartition;
 
+SlabCache *g_inodeCache;
+SlabCache *g_dirCache;
+SlabCache *g_ioBufCache;
+
 /* 格式化分区 */
 static void FS_PartitionFormat(Partition *part)
 {
@@ -25,7 +30,7 @@ static void FS_PartitionFormat(Partition *part)
     uint32_t bootSectorSects = 1;	  
     uint32_t superBlockSects = 1;
     uint32_t inodeBitmapSects = DIV_ROUND_UP(MAX_FILES_PER_PART, BITS_PER_SECTOR);	   // I结点位图占用的扇区数.最多支持4096个文件
-    uint32_t inodeTableSects = DIV_ROUND_UP((sizeof(Inode) * MAX_FILES_PER_PART), SECTOR_PER_SIZE);
+    uint32_t inodeTableSects = DIV_ROUND_UP((sizeof(DiskInode) * MAX_FILES_PER_PART), SECTOR_PER_SIZE);
     uint32_t usedSects = bootSectorSects + superBlockSects + inodeBitmapSects + inodeTableSects;
     uint32_t freeSects = part->secCnt - usedSects;
 
@@ -143,7 +148,7 @@ static void FS_PartitionFormat(Partition *part)
      ***************************************/
     /* 准备写inode_table中的第0项,即根目录所在的inode */
     memset(buf, 0, bufSize);  // 先清空缓冲区buf
-    Inode* i = (Inode *)buf; 
+    DiskInode* i = (DiskInode *)buf; 
     i->iSize = superBlock.dirEntrySize * 2;	 // .和..
     i->iNo = 0;   // 根目录占inode数组中第0个inode
     i->iSectors[0] = superBlock.dataStartLBA;	     // 由于上面的memset,i_sectors数组的其它元素都初始化为0 
@@ -206,6 +211,7 @@ static void FS_Mount(ListNode *partNode, void *arg)
             PANIC("sys_malloc failed!");
         }
         g_curPartition->blockBitmap.bitmapLen = superBlock.blockBitmapSects * SECTOR_PER_SIZE;
+        g_curPartition->blockBitmap.freeHint = 0;
         /* 从硬盘读入位图信息 */
         Ide_Read(part->disk, superBlock.blockBitmapLBA, g_curPartition->blockBitmap.bitmap, superBlock.blockBitmapSects);
 
@@ -213,7 +219,8 @@ static void FS_Mount(ListNode *partNode, void *arg)
         if (g_curPartition->inodeBitmap.bitmap == NULL) {
             PANIC("sys_malloc failed!");
         }
-        g_curPartition->blockBitmap.bitmapLen = superBlock.inodeBitmapSects * SECTOR_PER_SIZE;
+        g_curPartition->inodeBitmap.bitmapLen = superBlock.inodeBitmapSects * SECTOR_PER_SIZE;
+        g_curPartition->inodeBitmap.freeHint = 0;
         /* 从硬盘读入inode位图 */
         Ide_Read(part->disk, superBlock.inodeBitmapLBA, g_curPartition->inodeBitmap.bitmap, superBlock.inodeBitmapSects);
 
@@ -341,6 +348,14 @@ void FS_Init(void)
 {
     Console_PutStr("FS_Init Start.");
 
+    /* 创建文件系统对象缓存 */
+    g_inodeCache = Slab_CacheCreate("inode", sizeof(Inode), NULL);
+    g_dirCache = Slab_CacheCreate("dir", sizeof(Dir), NULL);
+    g_ioBufCache = Slab_CacheCreate("fs_io_buf", FS_IO_BUF_SIZE, NULL);
+    if ((g_inodeCache == NULL) || (g_dirCache == NULL) || (g_ioBufCache == NULL)) {
+        PANIC("Slab_CacheCreate failed!");
+    }
+
     uint8_t channelNo = 0;
     uint8_t partIdx = 0;
 
@@ -362,8 +377,8 @@ void FS_Init(void)
                     part = hd->logicParts;
                 }
 
-                /* 分区存在 */
-                if (part->secCnt != 0) {
+                /* 分区存在，交换分区是裸分区，不建立文件系统 */
+                if ((part->secCnt != 0) && (strcmp(part->name, SWAP_PART_NAME) != 0)) {
                     /* 从分区读出超级块，通过超级块判断分区是否已经格式化 
                        超级块位于分区第一个扇区(块)，大小为一个扇区(块) */
                     SuperBlock superBlock = {0};
@@ -447,7 +462,7 @@ int32_t sys_unlink(const char *pathName)
 
     ASSERT(fileIndex == MAX_FILE_OPEN);
 
-    void *ioBuf = sys_malloc(SECTOR_PER_SIZE + SECTOR_PER_SIZE);
+    void *ioBuf = Slab_Alloc(g_ioBufCache);
     if (ioBuf == NULL) {
         Dir_Close(searchedRecord.parentDir);
         Console_PutStr("sys_unlink: malloc for ioBuf failed\n");
@@ -457,7 +472,7 @@ int32_t sys_unlink(const char *pathName)
     Dir *parentDir = searchedRecord.parentDir;
     Dir_DeleteDirEntry(g_curPartition, parentDir, inodeNo, ioBuf);
     Inode_Release(g_curPartition, inodeNo);
-    sys_free(ioBuf);
+    Slab_Free(g_ioBufCache, ioBuf);
     Dir_Close(searchedRecord.parentDir);
 
     return 0;
@@ -467,9 +482,9 @@ int32_t sys_unlink(const char *pathName)
 int32_t sys_mkdir(const char *pathName)
 {
     uint8_t rollBackStep = 0;
-    void *ioBuf = sys_malloc(SECTOR_PER_SIZE * 2);
+    void *ioBuf = Slab_Alloc(g_ioBufCache);
     if (ioBuf == NULL) {
-        Console_PutStr("sys_mkdir: sys_malloc for ioBuf failed\n");
+        Console_PutStr("sys_mkdir: Slab_Alloc for ioBuf failed\n");
         return -1;
     }
 
@@ -555,7 +570,7 @@ int32_t sys_mkdir(const char *pathName)
     memset(ioBuf, 0, SECTOR_PER_SIZE * 2);
     File_BitmapSync(g_curPartition, inodeNo, INODE_BITMAP);
 
-    sys_free(ioBuf);
+    Slab_Free(g_ioBufCache, ioBuf);
     Dir_Close(searchedRecord.parentDir);
 
     return 0;
@@ -570,7 +585,7 @@ rollback:
             break;
     }
 
-    sys_free(ioBuf);
+    Slab_Free(g_ioBufCache, ioBuf);
     return -1;
 }
 
@@ -8,6 +8,7 @@
 
 #include "stdint.h"
 #include "kernel/device/ide.h"
+#include "kernel/slab.h"
 
 /* 每个分区支持最大创建的文件数 */
 #define MAX_FILES_PER_PART      4096
@@ -21,8 +22,16 @@
 /* 最大路径长度 */
 #define MAX_PATH_LEN 512
 
+/* 文件系统IO缓冲区大小，inode、目录项、位图的同步最多涉及两个扇区 */
+#define FS_IO_BUF_SIZE          (SECTOR_PER_SIZE * 2)
+
 extern Partition *g_curPartition;
 
+/* 文件系统对象缓存，对象总是分配在内核空间，由所有任务共享 */
+extern SlabCache *g_inodeCache;
+extern SlabCache *g_dirCache;
+extern SlabCache *g_ioBufCache;
+
 /* 文件读写偏移 */
 typedef enum {
     SEEK_SET,
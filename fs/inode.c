@@ -29,7 +29,7 @@ static void Inode_Locate(Partition *part, uint32_t inodeNo, InodePosition *inode
     ASSERT(inodeNo < 4096);
     uint32_t inodeTableLBA = part->sb->inodeTableLBA;
 
-    uint32_t inodeSize = sizeof(Inode);
+    uint32_t inodeSize = sizeof(DiskInode);
     /* 偏移字节量 */
     uint32_t offSize = inodeNo * inodeSize;
     /* 偏移扇区量 */
@@ -59,13 +59,12 @@ void Inode_Write(Partition *part, const Inode *inode, void *ioBuf)
     Inode_Locate(part, inodeNo, &inodePosition);
     ASSERT(inodePosition.secLAB <= (part->startLBA + part->secCnt));
 
-    Inode pureInode;
-    memcpy(&pureInode, inode, sizeof(Inode));
-    /* 写入硬盘是，下面信息不起作用 */
-    pureInode.iOpenCnts = 0;
-    pureInode.writeDeny = false;
-    pureInode.inodeTag.prev = NULL;
-    pureInode.inodeTag.next = NULL;
+    /* 只写入需要持久化的成员，打开次数、写标志和链表节点不写入硬盘 */
+    DiskInode pureInode;
+    memset(&pureInode, 0, sizeof(DiskInode));
+    pureInode.iNo = inode->iNo;
+    pureInode.iSize = inode->iSize;
+    memcpy(pureInode.iSectors, inode->iSectors, sizeof(pureInode.iSectors));
 
     /* 扇区读写都是以整块为单位，如果读写不足一扇区，需要先从硬盘读取一扇区，再拼接内容，最终写入扇区 */
     uint32_t secCnt = 1;
@@ -97,7 +96,7 @@ void Inode_Delete(Partition *part, uint32_t inodeNo, void *ioBuf)
 
     /* inode跨区，需要读取两个扇区 */
     Ide_Read(part->disk, inodePos.secLAB, ioBuf, sectorNum);
-    memset(ioBuf + inodePos.offSize, 0, sizeof(Inode));
+    memset(ioBuf + inodePos.offSize, 0, sizeof(DiskInode));
     Ide_Write(part->disk, inodePos.secLAB, ioBuf, sectorNum);
 
     return;
@@ -143,13 +142,13 @@ void Inode_Release(Partition *part, uint32_t inodeNo)
     BitmapSet(&part->inodeBitmap, inodeNo, 0);
     File_BitmapSync(part, inodeNo, INODE_BITMAP);
     /* 最多涉及两个块的读取 */
-    uint8_t *ioBuf = sys_malloc(1024);
+    uint8_t *ioBuf = Slab_Alloc(g_ioBufCache);
     if (ioBuf == NULL) {
-        Console_PutStr("inode_release:sys_malloc error.\n");
+        Console_PutStr("inode_release:Slab_Alloc error.\n");
         return;
     }
     Inode_Delete(part, inodeNo, ioBuf);
-    sys_free(ioBuf);
+    Slab_Free(g_ioBufCache, ioBuf);
 
     Inode_Close(inodeDelete);
 
@@ -163,7 +162,7 @@ Inode *Inode_Open(Partition *part, uint32_t inodeNo)
     ListNode *inodeTag = part->openInodes.head.next;
     while (inodeTag != &part->openInodes.tail) {
         Inode *inode = ELEM2ENTRY(Inode, inodeTag, inodeTag);
-        if (inode->iNo = inodeNo) {
+        if (inode->iNo == inodeNo) {
             inode->iOpenCnts++;
             return inode;
         }
@@ -175,34 +174,27 @@ Inode *Inode_Open(Partition *part, uint32_t inodeNo)
     InodePosition inodePosition = {0};
     Inode_Locate(part, inodeNo, &inodePosition);
 
-    /* 为了使得inode被所有任务共享，可以强行将inode分配在内核空间 */
-    Task *task = Thread_GetRunningTask();
-    uint32_t *pgDir = task->pgDir;
-    /* pgDir为空认为是内核线程，分配的内存也会在内核空间 */
-    task->pgDir = NULL; 
-    Inode *inode = (Inode *)sys_malloc(sizeof(Inode));
-    /* 恢复pgDir */
-    task->pgDir = pgDir;
-
-    uint32_t inodeBufSize = PAGE_SIZE;
-    if (inodePosition.twoSec == true) {
-        inodeBufSize = 2 * PAGE_SIZE;
-    }
-
-    char *inodeBuf = (char *)sys_malloc(inodeBufSize);
-    if (inodeBufSize == NULL) {
-        PANIC("sys_malloc failed!");
+    /* inode需要被所有任务共享，从内核对象缓存中分配 */
+    Inode *inode = (Inode *)Slab_Alloc(g_inodeCache);
+    char *inodeBuf = (char *)Slab_Alloc(g_ioBufCache);
+    if ((inode == NULL) || (inodeBuf == NULL)) {
+        PANIC("Slab_Alloc failed!");
     }
 
     /* 从硬盘读取inode，需要考虑跨扇区的场景 */
-    Ide_Read(part->disk, inodePosition.secLAB, inodeBuf, inodeBufSize / PAGE_SIZE);
+    uint32_t secCnt = (inodePosition.twoSec == true) ? 2 : 1;
+    Ide_Read(part->disk, inodePosition.secLAB, inodeBuf, secCnt);
 
-    memcpy(inode, inodeBuf + inodePosition.offSize, sizeof(Inode));
+    const DiskInode *diskInode = (const DiskInode *)(inodeBuf + inodePosition.offSize);
+    inode->iNo = diskInode->iNo;
+    inode->iSize = diskInode->iSize;
+    inode->writeDeny = false;
+    memcpy(inode->iSectors, diskInode->iSectors, sizeof(inode->iSectors));
 
     List_Push(&part->openInodes, &inode->inodeTag);
     inode->iOpenCnts = 1;
 
-    sys_free(inodeBuf);
+    Slab_Free(g_ioBufCache, inodeBuf);
 
     return inode;
 }
@@ -214,12 +206,7 @@ void Inode_Close(Inode *inode)
     inode->iOpenCnts--;
     if (inode->iOpenCnts == 0) {
         List_Remove(&inode->inodeTag);
-        /* 在内核空间中释放inode空间 */
-        Task *task = Thread_GetRunningTask();
-        uint32_t *pgDir = task->pgDir;
-        task->pgDir = NULL;
-        sys_free(inode);
-        task->pgDir = pgDir;
+        Slab_Free(g_inodeCache, inode);
     }
 
     Idt_SetIntrStatus(status);
@@ -53,6 +53,18 @@ typedef struct {
     ListNode inodeTag;
 } Inode;
 
+/* 硬盘上的inode，只保存需要持久化的成员，不随内存中Inode的链表节点等成员变化 */
+typedef struct {
+    uint32_t iNo;
+    uint32_t iSize;
+    /* 以下两项在硬盘上始终为0，保留位置使布局与已有分区一致 */
+    uint32_t iOpenCnts;
+    bool writeDeny;
+    uint32_t iSectors[MAX_SECTOR_PRE_INODE];
+    /* 原inode链表节点的位置，始终为0 */
+    uint32_t reserved[2];
+} DiskInode;
+
 /* 将inode写入分区中 */
 void Inode_Write(Partition *part, const Inode *inode, void *ioBuf);
 /* 根据i节点号返回i节点 */
@@ -8,6 +8,9 @@
 #include "kernel/panic.h"
 #include "lib/string.h"
 
+/* 扫描时每次处理的位数 */
+#define BITMAP_WORD_BITS 32
+
 /* 位图初始化函数 */
 void BitmapInit(Bitmap *bitmap)
 {
@@ -15,6 +18,7 @@ void BitmapInit(Bitmap *bitmap)
     ASSERT(bitmap != NULL);
 
     memset(bitmap->bitmap, 0, bitmap->bitmapLen);
+    bitmap->freeHint = 0;
 
     return;
 }
@@ -30,6 +34,16 @@ uint32_t BitmapGet(Bitmap *bitmap, uint32_t bitIndex)
     return (bitmap->bitmap[bitIndex / 8] & (1 << (bitIndex % 8))) >> (bitIndex % 8);
 }
 
+/* 直接写入第bitIndex位，不做校验 */
+static inline void BitmapWriteBit(Bitmap *bitmap, uint32_t bitIndex, uint8_t value)
+{
+    if (value == 1) {
+        bitmap->bitmap[bitIndex / 8] |= (1 << (bitIndex % 8)); 
+    } else {
+        bitmap->bitmap[bitIndex / 8] &= ~(1 << (bitIndex % 8)); 
+    }
+}
+
 /* 设置位图bitIndex位函数 */
 void BitmapSet(Bitmap *bitmap, uint32_t bitIndex, uint8_t value)
 {
@@ -40,46 +54,145 @@ void BitmapSet(Bitmap *bitmap, uint32_t bitIndex, uint8_t value)
     /* value非0即1 */
     ASSERT((value == 0) || (value == 1));
 
-    if (value == 1) {
-        bitmap->bitmap[bitIndex / 8] |= (1 << (bitIndex % 8)); 
-    } else {
-        bitmap->bitmap[bitIndex / 8] &= ~(1 << (bitIndex % 8)); 
+    BitmapWriteBit(bitmap, bitIndex, value);
+
+    /* 维护空闲游标：释放低位时游标回退，占用游标所在位时游标前移 */
+    if ((value == 0) && (bitIndex < bitmap->freeHint)) {
+        bitmap->freeHint = bitIndex;
+    } else if ((value == 1) && (bitIndex == bitmap->freeHint)) {
+        bitmap->freeHint++;
     }
 
     return;
 }
 
-/* 第k位是否已经被使用 */
-static bool BitmapBitIndexUsed(Bitmap *bitmap, uint32_t k)
+/* 将位图从bitIndex开始的n位设置为value */
+void BitmapSetRange(Bitmap *bitmap, uint32_t bitIndex, uint32_t n, uint8_t value)
 {
-    uint32_t index = k / 8;
-    uint8_t bitMask = (1 << (k % 8));
+    ASSERT(bitmap != NULL);
+    ASSERT(bitmap->bitmapLen * 8 >= bitIndex + n);
+    ASSERT((value == 0) || (value == 1));
 
-    /* 第k位未被使用 */
-    if (((bitmap->bitmap[index]) & bitMask) == 0) {
-        return false;
+    uint32_t start = bitIndex;
+    uint32_t end = bitIndex + n;
+
+    /* 先处理首部不足一字节的位 */
+    while ((bitIndex < end) && (bitIndex % 8 != 0)) {
+        BitmapWriteBit(bitmap, bitIndex, value);
+        bitIndex++;
     }
 
-    return true;
+    /* 中间的整字节直接填充 */
+    uint32_t byteCnt = (end - bitIndex) / 8;
+    memset(bitmap->bitmap + bitIndex / 8, (value == 1) ? 0xff : 0, byteCnt);
+    bitIndex += byteCnt * 8;
+
+    /* 最后处理尾部不足一字节的位 */
+    while (bitIndex < end) {
+        BitmapWriteBit(bitmap, bitIndex, value);
+        bitIndex++;
+    }
+
+    if ((value == 0) && (start < bitmap->freeHint)) {
+        bitmap->freeHint = start;
+    } else if ((value == 1) && (start <= bitmap->freeHint) && (bitmap->freeHint < end)) {
+        bitmap->freeHint = end;
+    }
+
+    return;
+}
+
+/* 读取位图中第wordIndex个32位字，超出位图长度的部分视为已被占用 */
+static inline uint32_t BitmapLoadWord(const Bitmap *bitmap, uint32_t wordIndex)
+{
+    uint32_t byteIndex = wordIndex * (BITMAP_WORD_BITS / 8);
+    if (byteIndex + (BITMAP_WORD_BITS / 8) <= bitmap->bitmapLen) {
+        return *(const uint32_t *)(bitmap->bitmap + byteIndex);
+    }
+
+    uint32_t word = 0xffffffff;
+    for (uint32_t i = 0; (i < BITMAP_WORD_BITS / 8) && (byteIndex + i < bitmap->bitmapLen); i++) {
+        word &= ~((uint32_t)0xff << (i * 8));
+        word |= (uint32_t)bitmap->bitmap[byteIndex + i] << (i * 8);
+    }
+
+    return word;
+}
+
+/* 返回word中最低的置1位下标，word不能为0 */
+static inline uint32_t BitmapBsf(uint32_t word)
+{
+    uint32_t index;
+    __asm__ ("bsfl %1, %0" : "=r"(index) : "rm"(word) : "cc");
+    return index;
+}
+
+/* 从第bitIndex位开始查找第一个空闲位，找不到则返回位图总位数 */
+static uint32_t BitmapNextZero(const Bitmap *bitmap, uint32_t bitIndex)
+{
+    uint32_t bitsTotal = bitmap->bitmapLen * 8;
+    if (bitIndex >= bitsTotal) {
+        return bitsTotal;
+    }
+
+    uint32_t wordIndex = bitIndex / BITMAP_WORD_BITS;
+    /* 首个字中低于bitIndex的位视为已被占用 */
+    uint32_t word = BitmapLoadWord(bitmap, wordIndex) | ((1U << (bitIndex % BITMAP_WORD_BITS)) - 1);
+    /* 整字都被占用则直接跳过 */
+    while (word == 0xffffffff) {
+        wordIndex++;
+        if (wordIndex * BITMAP_WORD_BITS >= bitsTotal) {
+            return bitsTotal;
+        }
+        word = BitmapLoadWord(bitmap, wordIndex);
+    }
+
+    return wordIndex * BITMAP_WORD_BITS + BitmapBsf(~word);
+}
+
+/* 从第bitIndex位开始查找第一个已占用位，最多查找到limit位，找不到则返回limit */
+static uint32_t BitmapNextOne(const Bitmap *bitmap, uint32_t bitIndex, uint32_t limit)
+{
+    uint32_t wordIndex = bitIndex / BITMAP_WORD_BITS;
+    /* 首个字中低于bitIndex的位视为空闲 */
+    uint32_t word = BitmapLoadWord(bitmap, wordIndex) & ~((1U << (bitIndex % BITMAP_WORD_BITS)) - 1);
+    /* 整字都空闲则直接跳过 */
+    while (word == 0) {
+        wordIndex++;
+        if (wordIndex * BITMAP_WORD_BITS >= limit) {
+            return limit;
+        }
+        word = BitmapLoadWord(bitmap, wordIndex);
+    }
+
+    uint32_t oneIndex = wordIndex * BITMAP_WORD_BITS + BitmapBsf(word);
+    return (oneIndex < limit) ? oneIndex : limit;
 }
 
 /* 查找n个大小合适的空间，如果找到则返回起始index，否则返回-1 */
 int32_t BitmapScan(Bitmap *bitmap, uint32_t n)
 {
-    /* bitmap位图中最多有(bitmap->bitmapLen + 1) * 8位 */
-    for (uint32_t i = 0; i + n < ((bitmap->bitmapLen + 1) * 8); i++) {
-        uint32_t cnt = 0;
-        while (BitmapBitIndexUsed(bitmap, i + cnt) == false) {
-            cnt++;
-            /* 找到n个合适空间，返回起始index，即i */
-            if (cnt >= n) {
-                return i;
-            }
+    ASSERT(bitmap != NULL);
+
+    uint32_t bitsTotal = bitmap->bitmapLen * 8;
+    if ((n == 0) || (n > bitsTotal)) {
+        return -1;
+    }
+
+    /* freeHint以下的位均已被占用，直接从游标处开始查找 */
+    uint32_t start = BitmapNextZero(bitmap, bitmap->freeHint);
+    bitmap->freeHint = start;
+
+    while (start + n <= bitsTotal) {
+        /* 计算从start开始的空闲段长度，最多统计n位 */
+        uint32_t end = BitmapNextOne(bitmap, start, start + n);
+        if (end - start >= n) {
+            return start;
         }
 
-        /* 连续第i + cnt位已经被使用，下次从i + cnt下一位开始遍历 */
-        i += cnt;
+        /* 空闲段不够长，从下一个空闲位重新开始 */
+        start = BitmapNextZero(bitmap, end);
     }
 
     return -1;
-}
\ No newline at end of file
+}
@@ -12,6 +12,8 @@
 typedef struct {
     uint32_t bitmapLen;
     uint8_t  *bitmap;
+    /* 最低可能空闲位，低于该位的bit均已被占用，由BitmapSet维护 */
+    uint32_t freeHint;
 } Bitmap;
 
 /* 位图初始化函数 */
@@ -26,4 +28,7 @@ uint32_t BitmapGet(Bitmap *bitmap, uint32_t bitIndex);
 /* 设置位图bitIndex的值 */
 void BitmapSet(Bitmap *bitmap, uint32_t bitIndex, uint8_t value);
 
-#endif
\ No newline at end of file
+/* 将位图从bitIndex开始的n位设置为value */
+void BitmapSetRange(Bitmap *bitmap, uint32_t bitIndex, uint32_t n, uint8_t value);
+
+#endif
@@ -10,6 +10,7 @@
 #include "kernel/interrupt.h"
 #include "kernel/thread.h"
 #include "kernel/global.h"
+#include "kernel/panic.h"
 #include "lib/print.h"
 
 #define COUNTER0_PORT      0x40
@@ -19,6 +20,46 @@
 #define COUNTER0_FREQUENCY (INPUT_FREQUENCY / IRQ0_FREQUENCY)
 
 static uint32_t g_sysTicks = 0;
+/* 单调时钟：以8253输入时钟周期计时，g_sysTicks之外不足一个tick的周期数 */
+static uint32_t g_clockCycles = 0;
+
+/* 动态时钟：0号计数器工作在模式0，每次中断后按下一个事件重新编程单次计数。
+ * 16位计数器最多计65535个周期，约55ms，即单次最多跨TIMER_ONESHOT_MAX_TICKS个tick */
+#define TIMER_ONESHOT_MAX_TICKS (0xffff / COUNTER0_FREQUENCY)
+/* 单次计数的最小值，避免写入计数器前就已经到期 */
+#define TIMER_ONESHOT_MIN       64
+static bool g_tickless = false;
+/* 当前单次计数值 */
+static uint32_t g_pitCount = 0;
+/* 提前重新编程前计数器已经走过的周期数 */
+static uint32_t g_pitPartial = 0;
+/* 下一次时钟中断对应的tick */
+static uint32_t g_nextEventTick = 0;
+/* 是否正在时钟中断中处理时间轮，此时由中断返回前统一编程 */
+static bool g_inTimerIntr = false;
+
+/* 分层时间轮：第1级256个槽，每个槽1个tick；其余4级各64个槽，每个槽是上一级的一整圈，
+ * 共覆盖2^32个tick。定时器按剩余时间放入对应级别的槽中，第1级转完一圈时把上一级的
+ * 当前槽逐个重新插入下一级，每个tick只处理一个槽，与定时器个数无关 */
+#define TIMER_ROOT_BITS    8
+#define TIMER_LEVEL_BITS   6
+#define TIMER_ROOT_SIZE    (1 << TIMER_ROOT_BITS)
+#define TIMER_LEVEL_SIZE   (1 << TIMER_LEVEL_BITS)
+#define TIMER_ROOT_MASK    (TIMER_ROOT_SIZE - 1)
+#define TIMER_LEVEL_MASK   (TIMER_LEVEL_SIZE - 1)
+#define TIMER_LEVELS       4
+
+static List g_timerRoot[TIMER_ROOT_SIZE];
+static List g_timerLevels[TIMER_LEVELS][TIMER_LEVEL_SIZE];
+/* 时间轮下一个要处理的tick */
+static uint32_t g_timerTicks = 0;
+
+/* 利用时钟中断校准TSC频率，从第TSC_CALIB_START个tick开始统计TSC_CALIB_TICKS个tick */
+#define TSC_CALIB_START    10
+#define TSC_CALIB_TICKS    10
+static uint64_t g_tscCalibStart = 0;
+/* TSC频率，单位MHz */
+static uint32_t g_tscMhz = 0;
 
 /* 设置时钟中断周期 */
 static inline void Timer_SetFrequency(uint16_t timerFrequency)
@@ -37,33 +78,341 @@ static inline void Timer_SetFrequency(uint16_t timerFrequency)
     outb(COUNTER0_PORT, (uint8_t)(timerFrequency >> 8));
 }
 
+/* 以模式0启动一次单次计数，cycles个输入时钟周期后产生一次中断 */
+static void Timer_SetOneShot(uint32_t cycles)
+{
+    if (cycles < TIMER_ONESHOT_MIN) {
+        cycles = TIMER_ONESHOT_MIN;
+    } else if (cycles > 0xffff) {
+        cycles = 0xffff;
+    }
+
+    /* 0 << 1表示使用模式0，写入高8位后开始计数，计到0时输出一次上升沿 */
+    outb(PIT_CONTROL_PORT, (uint8_t)((0 << 6) | (3 << 4) | (0 << 1)));
+    outb(COUNTER0_PORT, (uint8_t)cycles);
+    outb(COUNTER0_PORT, (uint8_t)(cycles >> 8));
+    g_pitCount = cycles;
+}
+
+/* 读取0号计数器的当前值 */
+static uint32_t Timer_ReadCounter(void)
+{
+    /* 锁存命令：0 << 6选择0号计数器，读写属性为0 */
+    outb(PIT_CONTROL_PORT, (uint8_t)(0 << 6));
+    uint32_t low = inb(COUNTER0_PORT);
+    uint32_t high = inb(COUNTER0_PORT);
+
+    return (high << 8) | low;
+}
+
+/* 上次计入单调时钟以来单次计数走过的周期数，计数到0之后计数器从0xffff继续递减，
+ * 中断被推迟时超出的部分同样计入 */
+static uint32_t Timer_PendingCycles(void)
+{
+    uint32_t remain = Timer_ReadCounter();
+    uint32_t run = g_pitCount - remain;
+    if (remain > g_pitCount) {
+        run = g_pitCount + ((0x10000 - remain) & 0xffff);
+    }
+
+    return g_pitPartial + run;
+}
+
+/* 单调时钟前进cycles个输入时钟周期，返回前进的tick数 */
+static uint32_t Timer_AdvanceClock(uint32_t cycles)
+{
+    uint32_t ticks = 0;
+
+    g_clockCycles += cycles;
+    while (g_clockCycles >= COUNTER0_FREQUENCY) {
+        g_clockCycles -= COUNTER0_FREQUENCY;
+        g_sysTicks++;
+        ticks++;
+    }
+
+    return ticks;
+}
+
+/* 第level级(从0开始，不含第1级)中tick所在的槽下标 */
+static inline uint32_t Timer_LevelIdx(uint32_t ticks, uint32_t level)
+{
+    return (ticks >> (TIMER_ROOT_BITS + level * TIMER_LEVEL_BITS)) & TIMER_LEVEL_MASK;
+}
+
+/* 按剩余时间把定时器放入时间轮的槽中，调用者需关中断 */
+static void Timer_Insert(Timer *timer)
+{
+    uint32_t expires = timer->expires;
+    uint32_t delta = expires - g_timerTicks;
+    List *slot = NULL;
+
+    if ((int32_t)delta < 0) {
+        /* 已经过期的定时器在下一个tick处理 */
+        slot = &g_timerRoot[g_timerTicks & TIMER_ROOT_MASK];
+    } else if (delta < TIMER_ROOT_SIZE) {
+        slot = &g_timerRoot[expires & TIMER_ROOT_MASK];
+    } else {
+        uint32_t level = 0;
+        while ((level < TIMER_LEVELS - 1) &&
+               (delta >= (1U << (TIMER_ROOT_BITS + (level + 1) * TIMER_LEVEL_BITS)))) {
+            level++;
+        }
+        slot = &g_timerLevels[level][Timer_LevelIdx(expires, level)];
+    }
+
+    List_Append(slot, &timer->timerTag);
+}
+
+/* 把第level级当前槽中的定时器重新插入下一级，返回该槽下标 */
+static uint32_t Timer_Cascade(uint32_t level)
+{
+    uint32_t idx = Timer_LevelIdx(g_timerTicks, level);
+    List *slot = &g_timerLevels[level][idx];
+    while (!List_IsEmpty(slot)) {
+        Timer *timer = ELEM2ENTRY(Timer, timerTag, List_Pop(slot));
+        Timer_Insert(timer);
+    }
+
+    return idx;
+}
+
+/* 处理到当前tick为止到期的定时器，调用者需关中断 */
+static void Timer_RunWheel(void)
+{
+    while ((int32_t)(g_sysTicks - g_timerTicks) >= 0) {
+        uint32_t idx = g_timerTicks & TIMER_ROOT_MASK;
+        /* 第1级转完一圈，从上一级取下一批定时器，逐级向上直到某级没有进位 */
+        if (idx == 0) {
+            uint32_t level = 0;
+            while ((level < TIMER_LEVELS) && (Timer_Cascade(level) == 0)) {
+                level++;
+            }
+        }
+
+        List *slot = &g_timerRoot[idx];
+        g_timerTicks++;
+        while (!List_IsEmpty(slot)) {
+            Timer *timer = ELEM2ENTRY(Timer, timerTag, List_Pop(slot));
+            timer->pending = false;
+            timer->func(timer->arg);
+        }
+    }
+}
+
+/* 距离下一个需要处理的tick还有多少个tick，最多maxTicks，调用者需关中断。
+ * 只需检查第1级中接下来的几个槽；第1级转完一圈时要从上一级取定时器，也作为一个事件 */
+static uint32_t Timer_NextEventTicks(uint32_t maxTicks)
+{
+    for (uint32_t ticks = 1; ticks < maxTicks; ticks++) {
+        uint32_t tick = g_sysTicks + ticks;
+        if (((tick & TIMER_ROOT_MASK) == 0) || !List_IsEmpty(&g_timerRoot[tick & TIMER_ROOT_MASK])) {
+            return ticks;
+        }
+    }
+
+    return maxTicks;
+}
+
+/* 按下一个事件编程单次计数，needTick表示当前任务需要按tick轮转时间片，调用者需关中断 */
+static void Timer_ProgramNext(bool needTick)
+{
+    uint32_t ticks = needTick ? 1 : Timer_NextEventTicks(TIMER_ONESHOT_MAX_TICKS);
+
+    /* 中断落在tick边界上，单调时钟在中断中正好前进ticks个tick */
+    g_nextEventTick = g_sysTicks + ticks;
+    Timer_SetOneShot(ticks * COUNTER0_FREQUENCY - g_clockCycles);
+}
+
+/* 新定时器早于已编程的中断到期时，提前到tick重新编程，调用者需关中断 */
+static void Timer_Reprogram(uint32_t tick)
+{
+    uint32_t remain = Timer_ReadCounter();
+    if ((remain < TIMER_ONESHOT_MIN) || (remain > g_pitCount)) {
+        /* 计数即将或已经到期，中断处理时会重新编程 */
+        return;
+    }
+
+    g_pitPartial += g_pitCount - remain;
+    g_nextEventTick = tick;
+
+    /* 已经越过目标tick的边界时尽快产生中断 */
+    int32_t cycles = (int32_t)((tick - g_sysTicks) * COUNTER0_FREQUENCY - g_clockCycles - g_pitPartial);
+    Timer_SetOneShot((cycles > TIMER_ONESHOT_MIN) ? (uint32_t)cycles : TIMER_ONESHOT_MIN);
+}
+
+/* 动态时钟下请求在下一个tick产生时钟中断，需在关中断时调用 */
+void Timer_RequestTick(void)
+{
+    /* 时钟中断处理中会按任务情况统一编程 */
+    if (!g_tickless || g_inTimerIntr || ((int32_t)(g_nextEventTick - (g_sysTicks + 1)) <= 0)) {
+        return;
+    }
+
+    Timer_Reprogram(g_sysTicks + 1);
+}
+
+/* 初始化定时器 */
+void Timer_Setup(Timer *timer, TimerFunc func, void *arg)
+{
+    List_NodeInit(&timer->timerTag);
+    timer->expires = 0;
+    timer->func = func;
+    timer->arg = arg;
+    timer->pending = false;
+}
+
+/* 启动定时器，ticks个时钟周期后到期，已启动的定时器重新计时 */
+void Timer_Arm(Timer *timer, uint32_t ticks)
+{
+    ASSERT(timer->func != NULL);
+
+    IntrStatus oldStatus = Idt_IntrDisable();
+    if (timer->pending) {
+        List_Remove(&timer->timerTag);
+    }
+    timer->expires = g_sysTicks + ticks;
+    timer->pending = true;
+    Timer_Insert(timer);
+    if (g_tickless && !g_inTimerIntr && ((int32_t)(timer->expires - g_nextEventTick) < 0)) {
+        Timer_Reprogram(((int32_t)(timer->expires - g_sysTicks) > 0) ? timer->expires : g_sysTicks + 1);
+    }
+    Idt_SetIntrStatus(oldStatus);
+}
+
+/* 取消定时器，定时器尚未到期时返回true */
+bool Timer_Cancel(Timer *timer)
+{
+    IntrStatus oldStatus = Idt_IntrDisable();
+    bool pending = timer->pending;
+    if (pending) {
+        List_Remove(&timer->timerTag);
+        timer->pending = false;
+    }
+    Idt_SetIntrStatus(oldStatus);
+
+    return pending;
+}
+
 /* 时钟中断处理函数 */
 static void Timer_IntrHandler(void)
 {
     /* 获取当前正在运行的任务 */
     Task *currTask = Thread_GetRunningTask();
 
-    currTask->elapsedTicks++;
+    /* 周期模式下每次中断正好一个tick，动态时钟下读取计数器得到实际走过的周期，包含中断延迟 */
+    uint32_t cycles = COUNTER0_FREQUENCY;
+    bool oneShot = g_tickless;
+    if (oneShot) {
+        cycles = Timer_PendingCycles();
+    }
+    uint32_t ticks = Timer_AdvanceClock(cycles);
+
+    currTask->elapsedTicks += ticks;
+
+    /* 校准在周期模式下进行，此时每次中断系统ticks加1 */
+    if (g_sysTicks == TSC_CALIB_START) {
+        g_tscCalibStart = Timer_ReadTsc();
+    } else if (g_sysTicks == TSC_CALIB_START + TSC_CALIB_TICKS) {
+        /* 每个tick为(1000000 / IRQ0_FREQUENCY)微秒 */
+        uint32_t tscCycles = (uint32_t)(Timer_ReadTsc() - g_tscCalibStart);
+        g_tscMhz = tscCycles / (TSC_CALIB_TICKS * (1000000 / IRQ0_FREQUENCY));
+#ifdef TICKLESS
+        /* 校准完成后切换到动态时钟，下面统一编程单次计数 */
+        g_tickless = true;
+#endif
+    }
+
+    /* 到期定时器的回调可能唤醒任务，抢占在中断返回时完成 */
+    g_inTimerIntr = true;
+    Timer_RunWheel();
+    g_inTimerIntr = false;
 
-    /* 系统ticks加1 */
-    g_sysTicks++;
+    /* 实时FIFO任务不按时间片轮转，一直运行到阻塞或让出 */
+    bool sliceOut = (currTask->policy != SCHED_FIFO) && (currTask->ticks < ticks);
+
+    if (g_tickless) {
+        /* 空闲或只有一个任务运行时不需要周期时钟，直接睡到下一个定时器 */
+        bool needTick = sliceOut || (thread_need_resched != 0) || Thread_NeedTick();
+        /* 重新编程前计数器仍在走，补上处理中断期间经过的周期，跨过tick时尽快处理该tick */
+        if (oneShot && (Timer_AdvanceClock(Timer_PendingCycles() - cycles) > 0)) {
+            needTick = true;
+        }
+        g_pitPartial = 0;
+        Timer_ProgramNext(needTick);
+    }
 
-    if (currTask->ticks == 0) {
+    if (currTask->policy == SCHED_FIFO) {
+        return;
+    }
+
+    if (sliceOut) {
         /* CPU时间已经用完，进行任务调度 */
         Thread_Schedule();
     } else {
-        currTask->ticks--;
+        currTask->ticks -= ticks;
+    }
+}
+
+/* 将时间戳计数器周期数换算为纳秒，校准完成前返回0 */
+uint32_t Timer_Tsc2Ns(uint32_t cycles)
+{
+    if (g_tscMhz == 0) {
+        return 0;
     }
+
+    /* 拆成整除和余数两部分计算，避免32位溢出和64位除法 */
+    return (cycles / g_tscMhz) * 1000 + ((cycles % g_tscMhz) * 1000) / g_tscMhz;
 }
 
-/* 以tick位单位的sleep */
+/* 返回系统启动以来的毫秒数 */
+uint32_t Timer_GetMs(void)
+{
+    IntrStatus oldStatus = Idt_IntrDisable();
+    uint32_t ticks = g_sysTicks;
+    uint32_t cycles = g_clockCycles;
+    if (g_tickless) {
+        /* 动态时钟下两次中断可能相隔数个tick，读取计数器补上尚未计入的部分 */
+        cycles += Timer_PendingCycles();
+        while (cycles >= COUNTER0_FREQUENCY) {
+            cycles -= COUNTER0_FREQUENCY;
+            ticks++;
+        }
+    }
+    uint32_t ms = ticks * (1000 / IRQ0_FREQUENCY) + cycles / (INPUT_FREQUENCY / 1000);
+    Idt_SetIntrStatus(oldStatus);
+
+    return ms;
+}
+
+/* 返回系统启动以来的时钟中断次数 */
+uint32_t Timer_GetTicks(void)
+{
+    return g_sysTicks;
+}
+
+/* 睡眠定时器到期，唤醒睡眠的任务 */
+static void Timer_WakeUp(void *arg)
+{
+    Thread_UnBlock((Task *)arg);
+}
+
+/* 以tick位单位的sleep，任务阻塞到定时器到期，期间不占用处理器 */
 static void Timer_SleepTicks(uint32_t ticks)
 {
-    uint32_t startTicks = g_sysTicks;
-    while (g_sysTicks - startTicks < ticks) {
-        /* sleep时间未到，继续让出CPU使用权 */
-        Thread_Yield();
+    if (ticks == 0) {
+        return;
     }
+
+    /* 定时器在栈上，返回前必须确保已经从时间轮中摘除 */
+    Timer timer;
+    Timer_Setup(&timer, Timer_WakeUp, Thread_GetRunningTask());
+
+    /* 关中断后再启动定时器，保证任务先阻塞再被唤醒 */
+    IntrStatus oldStatus = Idt_IntrDisable();
+    Timer_Arm(&timer, ticks);
+    Thread_Block(TASK_WAITING);
+    Timer_Cancel(&timer);
+    Idt_SetIntrStatus(oldStatus);
 }
 
 /* 以毫秒为单位sleep */
@@ -78,6 +427,15 @@ void Timer_Init(void)
 {
     put_str("Timer_Init start. \n");
 
+    for (uint32_t idx = 0; idx < TIMER_ROOT_SIZE; idx++) {
+        List_Init(&g_timerRoot[idx]);
+    }
+    for (uint32_t level = 0; level < TIMER_LEVELS; level++) {
+        for (uint32_t idx = 0; idx < TIMER_LEVEL_SIZE; idx++) {
+            List_Init(&g_timerLevels[level][idx]);
+        }
+    }
+
     /* 设置时钟中断周期为每秒100次中断 */
     Timer_SetFrequency(COUNTER0_FREQUENCY);
 
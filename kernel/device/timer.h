@@ -7,10 +7,52 @@
 #define TIMER_H
 
 #include "stdint.h"
+#include "lib/list.h"
+
+/* 定时器到期回调，在时钟中断中关中断执行 */
+typedef void (*TimerFunc)(void *arg);
+
+/* 内核定时器，由调用者提供存储，挂在分层时间轮的槽中 */
+typedef struct {
+    ListNode timerTag;
+    /* 到期的tick */
+    uint32_t expires;
+    TimerFunc func;
+    void *arg;
+    /* 是否已启动且尚未到期 */
+    bool pending;
+} Timer;
+
+/* 初始化定时器 */
+void Timer_Setup(Timer *timer, TimerFunc func, void *arg);
+/* 启动定时器，ticks个时钟周期后到期，已启动的定时器重新计时 */
+void Timer_Arm(Timer *timer, uint32_t ticks);
+/* 取消定时器，定时器尚未到期时返回true */
+bool Timer_Cancel(Timer *timer);
 
 /* 以毫秒为单位sleep */
 void Timer_SleepMTime(uint32_t mSeconds);
 
+/* 读取时间戳计数器 */
+static inline uint64_t Timer_ReadTsc(void)
+{
+    uint32_t low, high;
+    __asm__ volatile ("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+/* 将时间戳计数器周期数换算为纳秒，校准完成前返回0 */
+uint32_t Timer_Tsc2Ns(uint32_t cycles);
+
+/* 返回系统启动以来的毫秒数 */
+uint32_t Timer_GetMs(void);
+
+/* 动态时钟下请求在下一个tick产生时钟中断，需在关中断时调用 */
+void Timer_RequestTick(void);
+
+/* 返回系统启动以来的时钟中断次数 */
+uint32_t Timer_GetTicks(void);
+
 void Timer_Init(void);
 
 #endif
\ No newline at end of file
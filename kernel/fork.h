@@ -0,0 +1,15 @@
+/*
+ *  kernel/fork.h
+ *
+ *  (C) 2021  Jacky
+ */
+#ifndef FORK_H
+#define FORK_H
+
+#include "stdint.h"
+#include "kernel/thread.h"
+
+/* fork子进程，父进程返回子进程pid，子进程返回0 */
+pid_t sys_fork(void);
+
+#endif
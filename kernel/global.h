@@ -86,7 +86,7 @@ typedef struct {
 /* 创建GDT描述符 */
 static inline GDTDesc MakeGDTDesc(uint32_t *descAddr, uint32_t limit, uint8_t attrLow, uint8_t attrHigh)
 {
-    uint32_t descBase = (uint32_t)descAddr;
+    uint32_t descBase = (uint32_t)(uintptr_t)descAddr;
     GDTDesc desc;
     desc.limitLowWord = limit & 0x0000ffff;
     desc.baseLowWord = descBase & 0x0000ffff;
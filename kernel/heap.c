@@ -0,0 +1,432 @@
+/*
+ *  kernel/heap.c
+ *
+ *  (C) 2021  Jacky
+ */
+
+#include "memory.h"
+#include "stdint.h"
+#include "kernel/panic.h"
+#include "kernel/sync.h"
+#include "kernel/thread.h"
+#include "kernel/interrupt.h"
+#include "kernel/global.h"
+#include "kernel/memprof.h"
+#include "lib/print.h"
+#include "lib/string.h"
+
+/* 堆分配器：小于等于1024字节的内存块按规格从arena中切分，更大的直接按页分配
+ * 页面通过Mem_MallocPages和Mem_Free获取和归还，不直接操作页表和物理内存池，
+ * 因此可以在bench/heap_bench.c中脱离内核编译
+ */
+
+/* 内核内存块描述符数组 */
+static MemBlockDesc kernelBlockDesc[DESC_CNT];
+
+/* 初始化内核内存块描述符数组 */
+void Mem_BlockDescInit(MemBlockDesc *memBlockDesc)
+{
+    uint32_t blockSize = 16;
+    for (uint8_t i = 0; i < DESC_CNT; i++) {
+        /* 每个内存块大小 */
+        memBlockDesc[i].blockSize = blockSize;
+        memBlockDesc[i].blockPerArena = (PAGE_SIZE - sizeof(MemArena)) / blockSize;
+        List_Init(&memBlockDesc[i].freeList);
+        List_Init(&memBlockDesc[i].emptyList);
+        memBlockDesc[i].emptyCnt = 0;
+        memBlockDesc[i].pageMapCnt = 0;
+        memBlockDesc[i].pageUnmapCnt = 0;
+        memBlockDesc[i].freeBlockCnt = 0;
+
+        blockSize *= 2;
+    }
+}
+
+/* 获取arena中的第n个内存块 */
+static inline MemBlock *Mem_Arena2Block(const MemArena *arena, uint32_t n)
+{
+    return (MemBlock *)((uintptr_t)arena + sizeof(MemArena) + n * arena->desc->blockSize);
+}
+
+/* 获取arena中的第n个内存块 */
+static inline MemArena *Mem_Block2Arena(const MemBlock *memBlock)
+{
+    return (MemArena *)((uintptr_t)memBlock & ~(uintptr_t)(PAGE_SIZE - 1));
+}
+
+/* 内存块大小对应的描述符下标，块大小从16字节开始逐级翻倍 */
+static inline uint32_t Mem_BlockSizeIdx(uint32_t blockSize)
+{
+    uint32_t idx;
+    __asm__ ("bsfl %1, %0" : "=r"(idx) : "r"(blockSize));
+    return idx - 4;
+}
+
+/* 从描述符中分配一个小内存块，调用者需持有内存池锁 */
+static MemBlock *Mem_BlockAlloc(VirMemType virMemType, MemBlockDesc *memBlockDesc)
+{
+    /* 先判断对应的描述符数组中是否还有空闲块 */
+    if (List_IsEmpty(&memBlockDesc->freeList)) {
+        /* 创建可用的内存空间 */
+        MemArena *arena = Mem_MallocPages(virMemType, 1);
+        if (arena == NULL) {
+            return NULL;
+        }
+
+        /* 将新创建的内存块划分成多个小块 */
+        arena->desc = memBlockDesc;
+        arena->cnt = memBlockDesc->blockPerArena;
+        arena->large = false;
+        arena->descIdx = Mem_BlockSizeIdx(memBlockDesc->blockSize);
+        memBlockDesc->pageMapCnt++;
+        memBlockDesc->freeBlockCnt += arena->cnt;
+        /* 新arena全空，先挂入emptyList，下面取出第一个块时再摘除 */
+        List_Push(&memBlockDesc->emptyList, &arena->emptyTag);
+        memBlockDesc->emptyCnt++;
+
+        /* 关中断，将内存块描述符添加到freelist中，新页中的块不可能已在链表中，无需逐个检查 */
+        IntrStatus status = Idt_IntrDisable();
+        
+        for (uint8_t i = 0; i < arena->cnt; i++) {
+            MemBlock *memBlock = Mem_Arena2Block(arena, i);
+            List_Append(&arena->desc->freeList, &memBlock->freeNode);
+        }
+
+        Idt_SetIntrStatus(status);
+    }
+
+    /* 取空闲列表头节点，分配使用 */
+    MemBlock *memBlock = (MemBlock *)List_Pop(&memBlockDesc->freeList);
+    MemArena *arena = Mem_Block2Arena(memBlock);
+    if (arena->cnt == memBlockDesc->blockPerArena) {
+        /* 保留的全空arena重新被使用 */
+        List_Remove(&arena->emptyTag);
+        memBlockDesc->emptyCnt--;
+    }
+    /* 所在的arena块空闲数量减1 */
+    arena->cnt--;
+    memBlockDesc->freeBlockCnt--;
+
+    return memBlock;
+}
+
+/* 将全空的arena从空闲链表中摘除并归还页框，调用者需持有内存池锁 */
+static void Mem_ArenaRelease(VirMemType type, MemArena *arena)
+{
+    for (uint32_t blockIndex = 0; blockIndex < arena->desc->blockPerArena; blockIndex++) {
+        MemBlock *memBlock = Mem_Arena2Block(arena, blockIndex);
+        ASSERT(List_Find(&arena->desc->freeList, &memBlock->freeNode) == true);
+        List_Remove(&memBlock->freeNode);
+    }
+
+    arena->desc->pageUnmapCnt++;
+    arena->desc->freeBlockCnt -= arena->desc->blockPerArena;
+    Mem_Free(type, (void *)arena, 1);
+}
+
+/* 回收一个小内存块，调用者需持有内存池锁 */
+static void Mem_BlockFree(VirMemType type, MemBlock *memBlock)
+{
+    MemArena *arena = Mem_Block2Arena(memBlock);
+    MemBlockDesc *memBlockDesc = arena->desc;
+    List_Append(&memBlockDesc->freeList, &memBlock->freeNode);
+    memBlockDesc->freeBlockCnt++;
+
+    arena->cnt++;
+    if (arena->cnt != memBlockDesc->blockPerArena) {
+        return;
+    }
+
+    /* 整块arena空闲时先保留，避免交替的申请释放反复映射页框 */
+    if (memBlockDesc->emptyCnt < MEM_EMPTY_ARENA_MAX) {
+        List_Push(&memBlockDesc->emptyList, &arena->emptyTag);
+        memBlockDesc->emptyCnt++;
+        return;
+    }
+
+    Mem_ArenaRelease(type, arena);
+}
+
+/* 获取当前任务使用的堆描述符数组 */
+static inline MemBlockDesc *Mem_HeapDesc(VirMemType type)
+{
+    return (type == VIR_MEM_KERNEL) ? kernelBlockDesc : Thread_GetRunningTask()->memblockDesc;
+}
+
+/* 释放描述符数组中保留的全部空arena，调用者需持有内存池锁 */
+static uint32_t Mem_ArenaReclaim(VirMemType type, MemBlockDesc *memBlockDesc)
+{
+    uint32_t pageCnt = 0;
+    for (uint32_t idx = 0; idx < DESC_CNT; idx++) {
+        while (!List_IsEmpty(&memBlockDesc[idx].emptyList)) {
+            MemArena *arena = ELEM2ENTRY(MemArena, emptyTag, List_Pop(&memBlockDesc[idx].emptyList));
+            memBlockDesc[idx].emptyCnt--;
+            Mem_ArenaRelease(type, arena);
+            pageCnt++;
+        }
+    }
+
+    return pageCnt;
+}
+
+/* 将弹匣中缓存的内存块全部归还内存池，调用者需持有内存池锁 */
+static void Mem_MagazineFlush(VirMemType type, MemMagazine *magazines)
+{
+    for (uint32_t idx = 0; idx < DESC_CNT; idx++) {
+        MemMagazine *mag = &magazines[idx];
+        for (uint32_t i = 0; i < mag->cnt; i++) {
+            Mem_BlockFree(type, (MemBlock *)mag->blocks[i]);
+        }
+        mag->cnt = 0;
+    }
+}
+
+/* 将堆中保留的全空arena归还物理内存池，返回释放的页数 */
+uint32_t Mem_Reclaim(VirMemType type)
+{
+    Mem_PoolLock(type);
+    /* 弹匣中的块使所在arena无法变为全空，先清空当前任务同类型的弹匣，其他任务的弹匣无锁访问，不能代为清空 */
+    Task *currTask = Thread_GetRunningTask();
+    if (type == ((currTask->pgDir == NULL) ? VIR_MEM_KERNEL : VIR_MEM_USER)) {
+        Mem_MagazineFlush(type, currTask->magazines);
+    }
+    uint32_t pageCnt = Mem_ArenaReclaim(type, Mem_HeapDesc(type));
+    Mem_PoolUnLock(type);
+
+    return pageCnt;
+}
+
+/* 打印内核堆各规格的页抖动统计 */
+void Mem_HeapPrint(void)
+{
+    for (uint32_t idx = 0; idx < DESC_CNT; idx++) {
+        MemBlockDesc *memBlockDesc = &kernelBlockDesc[idx];
+        put_str("heap ");
+        put_int(memBlockDesc->blockSize);
+        put_str(": empty ");
+        put_int(memBlockDesc->emptyCnt);
+        put_str(", map ");
+        put_int(memBlockDesc->pageMapCnt);
+        put_str(", unmap ");
+        put_int(memBlockDesc->pageUnmapCnt);
+        put_str("\n");
+    }
+}
+
+/* 初始化任务的弹匣数组 */
+void Mem_MagazineInit(MemMagazine *magazines)
+{
+    memset(magazines, 0, sizeof(MemMagazine) * DESC_CNT);
+}
+
+/* 将当前任务弹匣中缓存的内存块全部归还内存池，任务退出前调用 */
+void Mem_MagazineDrain(void)
+{
+    Task *currTask = Thread_GetRunningTask();
+    VirMemType type = (currTask->pgDir == NULL) ? VIR_MEM_KERNEL : VIR_MEM_USER;
+
+    Mem_PoolLock(type);
+    Mem_MagazineFlush(type, currTask->magazines);
+    Mem_PoolUnLock(type);
+}
+
+/* 打印当前任务各规格弹匣的命中情况 */
+void Mem_MagazinePrint(void)
+{
+    Task *currTask = Thread_GetRunningTask();
+    uint32_t blockSize = 16;
+    for (uint32_t idx = 0; idx < DESC_CNT; idx++) {
+        MemMagazine *mag = &currTask->magazines[idx];
+        put_str("magazine ");
+        put_int(blockSize);
+        put_str(": cnt ");
+        put_int(mag->cnt);
+        put_str(", hits ");
+        put_int(mag->hits);
+        put_str(", misses ");
+        put_int(mag->misses);
+        put_str("\n");
+        blockSize *= 2;
+    }
+}
+
+/* 在堆上申请size大小字节内存 */
+void *Mem_Malloc(uint32_t size)
+{
+    VirMemType virMemType; 
+    MemBlockDesc *memBlockDesc = NULL;
+    /* 获取当前正在执行的任务 */
+    Task *currTask = Thread_GetRunningTask();
+    if (currTask->pgDir == NULL) {
+        /* 内核线程申请内存 */
+        virMemType = VIR_MEM_KERNEL;
+        memBlockDesc = kernelBlockDesc;
+    } else {
+        /* 用户进程申请内存 */
+        virMemType = VIR_MEM_USER;
+        memBlockDesc = currTask->memblockDesc;
+    }
+
+    /* 判断是否有足够则空间，页框可以在两个内存池间迁移，按全部页框计算 */
+    if (DIV_ROUND_UP(size, PAGE_SIZE) >= Mem_TotalPages()) {
+        return NULL;
+    }
+
+    /* 如果分配的是大内存（超过1024字节，则整个页框分配）*/
+    if (size > 1024) {
+        Mem_PoolLock(virMemType);
+        uint32_t pageCnt = DIV_ROUND_UP(size + sizeof(MemArena), PAGE_SIZE);
+        /* 申请n个物理页框，并返回对应的虚拟地址 */
+        MemArena *arena = Mem_MallocPages(virMemType, pageCnt);
+        if (arena == NULL) {
+            Mem_PoolUnLock(virMemType);
+            return NULL;
+        }
+
+        /* 超过1024字节的内存块没有描述符 */
+        arena->desc = NULL;
+        arena->cnt = pageCnt;
+        arena->large = true;
+        Mem_PoolUnLock(virMemType);
+        /* 跳过开头的存放arena的空间，后面才是真正分配使用的内存 */
+        return (void *)(arena + 1);
+    }
+
+    /* 分配小内存，先找到对应描述符 */
+    uint8_t idx = 0;
+    while ((idx < DESC_CNT) && (memBlockDesc[idx].blockSize < size)) {
+        idx++;
+    }
+
+    ASSERT(idx < DESC_CNT);
+
+    /* 弹匣只被所属任务访问，命中时无需持有内存池锁 */
+    MemMagazine *mag = &currTask->magazines[idx];
+    if (mag->cnt > 0) {
+        mag->hits++;
+        mag->cnt--;
+        return mag->blocks[mag->cnt];
+    }
+
+    /* 弹匣为空，从内存池批量补充 */
+    mag->misses++;
+    Mem_PoolLock(virMemType);
+    MemBlock *memBlock = Mem_BlockAlloc(virMemType, &memBlockDesc[idx]);
+    if (memBlock != NULL) {
+        while (mag->cnt < MEM_MAG_BATCH) {
+            MemBlock *cacheBlock = Mem_BlockAlloc(virMemType, &memBlockDesc[idx]);
+            if (cacheBlock == NULL) {
+                break;
+            }
+            mag->blocks[mag->cnt++] = cacheBlock;
+        }
+    }
+    Mem_PoolUnLock(virMemType);
+
+    return (void *)memBlock;
+}
+
+#ifdef MEM_PROFILE
+/* 内核申请size字节时实际占用的规格大小 */
+static uint32_t Mem_SizeClass(uint32_t size)
+{
+    if (size > 1024) {
+        return DIV_ROUND_UP(size + sizeof(MemArena), PAGE_SIZE) * PAGE_SIZE;
+    }
+
+    uint32_t idx = 0;
+    while ((idx < DESC_CNT - 1) && (kernelBlockDesc[idx].blockSize < size)) {
+        idx++;
+    }
+
+    return kernelBlockDesc[idx].blockSize;
+}
+#endif
+
+void *sys_malloc(uint32_t size)
+{
+    void *addr = Mem_Malloc(size);
+#ifdef MEM_PROFILE
+    /* 按调用者的返回地址统计 */
+    MemProf_Alloc(addr, Mem_SizeClass(size), (uintptr_t)__builtin_return_address(0));
+#endif
+    return addr;
+}
+
+void sys_free(void *addr)
+{
+    ASSERT(addr != NULL);
+    if (addr == NULL) {
+        return;
+    }
+
+#ifdef MEM_PROFILE
+    MemProf_Free(addr);
+#endif
+
+    /* 通过判断是线程还是进程，获取到虚拟地址的类型 */
+    VirMemType type = (Thread_GetRunningTask()->pgDir == NULL) ? VIR_MEM_KERNEL : VIR_MEM_USER;
+
+    MemBlock *memBlock = (MemBlock *)addr;
+    MemArena *arena = Mem_Block2Arena(memBlock);
+    if (arena->large == true) {
+        /* 大于1024字节空间的内存块 */
+        Mem_PoolLock(type);
+        Mem_Free(type, (void *)arena, arena->cnt);
+        Mem_PoolUnLock(type);
+        return;
+    }
+
+    /* fork前由父进程分配的arena，其描述符仍指向父进程PCB(父进程可能已经退出)，改挂到当前任务同规格的描述符下。
+     * fork时在父进程中空闲的块只链在父进程的空闲链表中，子进程中视为已分配，随进程退出释放 */
+    Task *currTask = Thread_GetRunningTask();
+    MemBlockDesc *memBlockDesc = &currTask->memblockDesc[arena->descIdx];
+    if ((type == VIR_MEM_USER) && (arena->desc != memBlockDesc)) {
+        Mem_PoolLock(type);
+        arena->desc = memBlockDesc;
+        arena->cnt = 0;
+        Mem_PoolUnLock(type);
+    }
+
+    /* 小于或等于1024字节内存块先放回弹匣 */
+    MemMagazine *mag = &currTask->magazines[arena->descIdx];
+    if (mag->cnt < MEM_MAG_SIZE) {
+        mag->hits++;
+        mag->blocks[mag->cnt++] = memBlock;
+        return;
+    }
+
+    /* 弹匣已满，将最早放入的一批内存块归还内存池 */
+    mag->misses++;
+    Mem_PoolLock(type);
+    for (uint32_t i = 0; i < MEM_MAG_BATCH; i++) {
+        Mem_BlockFree(type, (MemBlock *)mag->blocks[i]);
+    }
+    Mem_PoolUnLock(type);
+
+    memcpy(&mag->blocks[0], &mag->blocks[MEM_MAG_BATCH], (MEM_MAG_SIZE - MEM_MAG_BATCH) * sizeof(void *));
+    mag->cnt = MEM_MAG_SIZE - MEM_MAG_BATCH;
+    mag->blocks[mag->cnt++] = memBlock;
+
+    return;
+}
+
+/* 内核堆初始化 */
+void Mem_HeapInit(void)
+{
+    Mem_BlockDescInit(kernelBlockDesc);
+}
+
+/* 填写内核堆和当前任务堆各规格的统计，arena数由映射和释放次数之差得到 */
+void Mem_HeapStat(MemHeapInfo *kernelHeap, MemHeapInfo *procHeap)
+{
+    MemBlockDesc *procDesc = Thread_GetRunningTask()->memblockDesc;
+    for (uint32_t idx = 0; idx < DESC_CNT; idx++) {
+        kernelHeap[idx].blockSize = kernelBlockDesc[idx].blockSize;
+        kernelHeap[idx].arenaCnt = kernelBlockDesc[idx].pageMapCnt - kernelBlockDesc[idx].pageUnmapCnt;
+        kernelHeap[idx].freeBlocks = kernelBlockDesc[idx].freeBlockCnt;
+        procHeap[idx].blockSize = procDesc[idx].blockSize;
+        procHeap[idx].arenaCnt = procDesc[idx].pageMapCnt - procDesc[idx].pageUnmapCnt;
+        procHeap[idx].freeBlocks = procDesc[idx].freeBlockCnt;
+    }
+}
@@ -8,6 +8,8 @@
 #include "stdint.h"
 #include "kernel/io.h"
 #include "kernel/global.h"
+#include "kernel/memory.h"
+#include "kernel/thread.h"
 #include "lib/print.h"
 
 /* 当前支持的中断数 */
@@ -140,6 +142,19 @@ static void Idt_GeneralIntrHendler(uint8_t vecNr)
     return;
 }
 
+/* 缺页异常处理函数，内存模块无法处理的缺页按通用异常处理 */
+static void Idt_PageFaultHandler(uint8_t vecNr)
+{
+    uintptr_t pageFaultAddr = 0;
+    /* 缺页异常的地址会存放到cr2寄存器 */
+    __asm__ volatile("movl %%cr2, %0" : "=r"(pageFaultAddr));
+    if (Mem_PageFault(pageFaultAddr)) {
+        return;
+    }
+
+    Idt_GeneralIntrHendler(vecNr);
+}
+
 /* 注册中断处理函数 */
 void Idt_RagisterHandler(uint8_t vecNr, intr_handler handler)
 {
@@ -175,6 +190,9 @@ static void Idt_IdtTableInit(void)
     intr_name[17] = "#AC Alignment Check Exception";
     intr_name[18] = "#MC Machine-Check Exception";
     intr_name[19] = "#XF SIMD Floating-Point Exception";
+
+    /* 缺页异常需要处理写时复制 */
+    idt_table[14] = Idt_PageFaultHandler;
     
     return;
 }
@@ -194,6 +212,11 @@ IntrStatus Idt_IntrEnable(void)
         return INTR_ON;
     }
 
+    /* 关中断期间唤醒了更高优先级的实时任务，开中断前先切换过去 */
+    if (thread_need_resched) {
+        Thread_Preempt();
+    }
+
     __asm__ volatile("sti");
 
     return INTR_OFF;
@@ -36,8 +36,17 @@ section .data
 %endmacro
 
 section .text
+extern thread_need_resched
+extern Thread_Preempt
 global intr_exit
 intr_exit:
+    ; 中断处理中唤醒了更高优先级的实时任务，返回前先切换过去
+    ; 处理函数可能打开了中断，iretd会恢复原来的eflags，这里先关中断
+    cli
+    cmp dword [thread_need_resched], 0
+    je .restore
+    call Thread_Preempt
+.restore:
     ; 恢复寄存器
     add esp, 4                ; 跳过中断号
     popad
@@ -0,0 +1,312 @@
+/*
+ *  kernel/kva.c
+ *
+ *  (C) 2021  Jacky
+ */
+
+#include "kva.h"
+#include "stdint.h"
+#include "kernel/memory.h"
+#include "kernel/panic.h"
+
+/* 最高置位的下标，x不能为0 */
+static inline uint32_t Kva_Fls(uint32_t x)
+{
+    uint32_t idx;
+    __asm__ ("bsrl %1, %0" : "=r"(idx) : "rm"(x) : "cc");
+    return idx;
+}
+
+/* 最低置位的下标，x不能为0 */
+static inline uint32_t Kva_Ffs(uint32_t x)
+{
+    uint32_t idx;
+    __asm__ ("bsfl %1, %0" : "=r"(idx) : "rm"(x) : "cc");
+    return idx;
+}
+
+/* 计算页数所属的一级、二级规格，小于KVA_SL_CNT的页数直接放在第0级 */
+static inline void Kva_Mapping(uint32_t pageCnt, uint32_t *fl, uint32_t *sl)
+{
+    if (pageCnt < KVA_SL_CNT) {
+        *fl = 0;
+        *sl = pageCnt;
+        return;
+    }
+
+    uint32_t msb = Kva_Fls(pageCnt);
+    *fl = msb - KVA_SL_LOG2 + 1;
+    *sl = (pageCnt >> (msb - KVA_SL_LOG2)) - KVA_SL_CNT;
+}
+
+static inline KvaExtent *Kva_Entry(ListNode *node)
+{
+    return ELEM2ENTRY(KvaExtent, sizeTag, node);
+}
+
+static inline uint32_t Kva_Hash(uintptr_t addr)
+{
+    return (addr / PAGE_SIZE) & (KVA_HASH_CNT - 1);
+}
+
+static inline uintptr_t Kva_End(const KvaExtent *ext)
+{
+    return ext->start + ext->pageCnt * PAGE_SIZE;
+}
+
+/* 将空闲区间加入规格链表和散列表 */
+static void Kva_Link(KvaPool *pool, KvaExtent *ext)
+{
+    uint32_t fl, sl;
+    Kva_Mapping(ext->pageCnt, &fl, &sl);
+    List_Push(&pool->freeList[fl][sl], &ext->sizeTag);
+    pool->slBitmap[fl] |= 1 << sl;
+    pool->flBitmap |= 1 << fl;
+
+    uint32_t startIdx = Kva_Hash(ext->start);
+    ext->startNext = pool->startHash[startIdx];
+    pool->startHash[startIdx] = ext;
+    uint32_t endIdx = Kva_Hash(Kva_End(ext));
+    ext->endNext = pool->endHash[endIdx];
+    pool->endHash[endIdx] = ext;
+
+    pool->freePages += ext->pageCnt;
+    pool->extentCnt++;
+}
+
+/* 将空闲区间从规格链表和散列表中摘除 */
+static void Kva_Unlink(KvaPool *pool, KvaExtent *ext)
+{
+    uint32_t fl, sl;
+    Kva_Mapping(ext->pageCnt, &fl, &sl);
+    List_Remove(&ext->sizeTag);
+    if (List_IsEmpty(&pool->freeList[fl][sl])) {
+        pool->slBitmap[fl] &= ~(1 << sl);
+        if (pool->slBitmap[fl] == 0) {
+            pool->flBitmap &= ~(1 << fl);
+        }
+    }
+
+    KvaExtent **link = &pool->startHash[Kva_Hash(ext->start)];
+    while (*link != ext) {
+        link = &(*link)->startNext;
+    }
+    *link = ext->startNext;
+
+    link = &pool->endHash[Kva_Hash(Kva_End(ext))];
+    while (*link != ext) {
+        link = &(*link)->endNext;
+    }
+    *link = ext->endNext;
+
+    pool->freePages -= ext->pageCnt;
+    pool->extentCnt--;
+}
+
+/* 取一个未使用的区间描述符，耗尽时返回NULL */
+static KvaExtent *Kva_GetNode(KvaPool *pool)
+{
+    if (List_IsEmpty(&pool->spareList)) {
+        return NULL;
+    }
+
+    return Kva_Entry(List_Pop(&pool->spareList));
+}
+
+static void Kva_PutNode(KvaPool *pool, KvaExtent *ext)
+{
+    List_Push(&pool->spareList, &ext->sizeTag);
+}
+
+/* 以nodeBuf中的bufSize字节作为区间描述符，初始化管理[start, end)的分配器 */
+void Kva_Init(KvaPool *pool, uintptr_t start, uintptr_t end, void *nodeBuf, uint32_t bufSize)
+{
+    ASSERT((start < end) && ((start & 0x00000fff) == 0) && ((end & 0x00000fff) == 0));
+
+    pool->start = start;
+    pool->end = end;
+    pool->flBitmap = 0;
+    pool->freePages = 0;
+    pool->extentCnt = 0;
+    for (uint32_t fl = 0; fl < KVA_FL_CNT; fl++) {
+        pool->slBitmap[fl] = 0;
+        for (uint32_t sl = 0; sl < KVA_SL_CNT; sl++) {
+            List_Init(&pool->freeList[fl][sl]);
+        }
+    }
+    for (uint32_t i = 0; i < KVA_HASH_CNT; i++) {
+        pool->startHash[i] = NULL;
+        pool->endHash[i] = NULL;
+    }
+
+    List_Init(&pool->spareList);
+    KvaExtent *nodes = nodeBuf;
+    uint32_t nodeCnt = bufSize / sizeof(KvaExtent);
+    ASSERT(nodeCnt > 0);
+    for (uint32_t i = 0; i < nodeCnt; i++) {
+        Kva_PutNode(pool, &nodes[i]);
+    }
+
+    KvaExtent *ext = Kva_GetNode(pool);
+    ext->start = start;
+    ext->pageCnt = (end - start) / PAGE_SIZE;
+    Kva_Link(pool, ext);
+}
+
+/* 在一级规格fl、二级规格不小于sl的链表中找到第一个非空链表，不存在返回NULL */
+static KvaExtent *Kva_FindSuitable(KvaPool *pool, uint32_t fl, uint32_t sl)
+{
+    uint32_t slMap = pool->slBitmap[fl] & (~0u << sl);
+    if (slMap == 0) {
+        uint32_t flMap = (fl + 1 < KVA_FL_CNT) ? (pool->flBitmap & (~0u << (fl + 1))) : 0;
+        if (flMap == 0) {
+            return NULL;
+        }
+        fl = Kva_Ffs(flMap);
+        slMap = pool->slBitmap[fl];
+    }
+
+    sl = Kva_Ffs(slMap);
+    return Kva_Entry(pool->freeList[fl][sl].head.next);
+}
+
+/* 分配pageCnt个连续虚拟页，失败返回NULL */
+uintptr_t Kva_Alloc(KvaPool *pool, uint32_t pageCnt)
+{
+    ASSERT(pageCnt > 0);
+
+    /* 把页数向上取整到下一个规格的起点，找到的链表中任一区间都足够大 */
+    uint32_t fl, sl;
+    uint32_t searchCnt = pageCnt;
+    if (pageCnt >= KVA_SL_CNT) {
+        searchCnt += (1 << (Kva_Fls(pageCnt) - KVA_SL_LOG2)) - 1;
+    }
+    Kva_Mapping(searchCnt, &fl, &sl);
+
+    KvaExtent *ext = (fl < KVA_FL_CNT) ? Kva_FindSuitable(pool, fl, sl) : NULL;
+    if (ext == NULL) {
+        /* 更大的规格都为空，最后在页数所属的规格链表中逐个查找 */
+        Kva_Mapping(pageCnt, &fl, &sl);
+        if (fl >= KVA_FL_CNT) {
+            return NULL;
+        }
+        ListNode *node = pool->freeList[fl][sl].head.next;
+        while ((node != &pool->freeList[fl][sl].tail) &&
+               (Kva_Entry(node)->pageCnt < pageCnt)) {
+            node = node->next;
+        }
+        if (node == &pool->freeList[fl][sl].tail) {
+            return NULL;
+        }
+        ext = Kva_Entry(node);
+    }
+
+    /* 从区间头部切出所需的页，剩余部分重新按规格挂链 */
+    Kva_Unlink(pool, ext);
+    uintptr_t start = ext->start;
+    if (ext->pageCnt > pageCnt) {
+        ext->start += pageCnt * PAGE_SIZE;
+        ext->pageCnt -= pageCnt;
+        Kva_Link(pool, ext);
+    } else {
+        Kva_PutNode(pool, ext);
+    }
+
+    return start;
+}
+
+/* 预留指定地址开始的pageCnt个页，不是空闲地址时返回-1 */
+int32_t Kva_Reserve(KvaPool *pool, uintptr_t addr, uint32_t pageCnt)
+{
+    uintptr_t end = addr + pageCnt * PAGE_SIZE;
+
+    /* 固定地址的预留很少使用，逐个规格链表查找包含该段地址的空闲区间 */
+    KvaExtent *ext = NULL;
+    for (uint32_t fl = 0; (fl < KVA_FL_CNT) && (ext == NULL); fl++) {
+        for (uint32_t sl = 0; (sl < KVA_SL_CNT) && (ext == NULL); sl++) {
+            ListNode *node = pool->freeList[fl][sl].head.next;
+            while (node != &pool->freeList[fl][sl].tail) {
+                KvaExtent *cur = Kva_Entry(node);
+                if ((cur->start <= addr) && (Kva_End(cur) >= end)) {
+                    ext = cur;
+                    break;
+                }
+                node = node->next;
+            }
+        }
+    }
+    if (ext == NULL) {
+        return -1;
+    }
+
+    /* 两侧都有剩余时需要多一个描述符 */
+    uintptr_t extEnd = Kva_End(ext);
+    KvaExtent *right = NULL;
+    if ((ext->start < addr) && (extEnd > end)) {
+        right = Kva_GetNode(pool);
+        if (right == NULL) {
+            return -1;
+        }
+    }
+
+    Kva_Unlink(pool, ext);
+    if (ext->start < addr) {
+        ext->pageCnt = (addr - ext->start) / PAGE_SIZE;
+        Kva_Link(pool, ext);
+        ext = right;
+    }
+    if (extEnd > end) {
+        ext->start = end;
+        ext->pageCnt = (extEnd - end) / PAGE_SIZE;
+        Kva_Link(pool, ext);
+    } else if (ext != NULL) {
+        Kva_PutNode(pool, ext);
+    }
+
+    return 0;
+}
+
+/* 归还从addr开始的pageCnt个页，并与相邻的空闲区间合并 */
+void Kva_Free(KvaPool *pool, uintptr_t addr, uint32_t pageCnt)
+{
+    uintptr_t end = addr + pageCnt * PAGE_SIZE;
+    ASSERT((addr >= pool->start) && (end <= pool->end) && (addr < end));
+
+    /* 通过散列表找到紧邻的前后空闲区间 */
+    KvaExtent *prev = pool->endHash[Kva_Hash(addr)];
+    while ((prev != NULL) && (Kva_End(prev) != addr)) {
+        prev = prev->endNext;
+    }
+    KvaExtent *next = pool->startHash[Kva_Hash(end)];
+    while ((next != NULL) && (next->start != end)) {
+        next = next->startNext;
+    }
+
+    KvaExtent *ext = NULL;
+    if (prev != NULL) {
+        Kva_Unlink(pool, prev);
+        addr = prev->start;
+        pageCnt += prev->pageCnt;
+        ext = prev;
+    }
+    if (next != NULL) {
+        Kva_Unlink(pool, next);
+        pageCnt += next->pageCnt;
+        if (ext == NULL) {
+            ext = next;
+        } else {
+            Kva_PutNode(pool, next);
+        }
+    }
+    if (ext == NULL) {
+        /* 描述符耗尽时这段地址继续保持占用，只损失虚拟地址，不影响正确性 */
+        ext = Kva_GetNode(pool);
+        if (ext == NULL) {
+            return;
+        }
+    }
+
+    ext->start = addr;
+    ext->pageCnt = pageCnt;
+    Kva_Link(pool, ext);
+}
@@ -0,0 +1,56 @@
+/*
+ *  kernel/kva.h
+ *
+ *  (C) 2021  Jacky
+ */
+#ifndef KVA_H
+#define KVA_H
+
+#include "stdint.h"
+#include "lib/list.h"
+
+/* 空闲区间按页数分为两级规格：一级为最高位，二级把每个一级区间再均分为4份 */
+#define KVA_FL_CNT   20
+#define KVA_SL_LOG2  2
+#define KVA_SL_CNT   (1 << KVA_SL_LOG2)
+/* 按起始、结束地址查找空闲区间的散列桶数 */
+#define KVA_HASH_CNT 256
+
+/* 一段空闲的内核虚拟地址[start, start + pageCnt * PAGE_SIZE) */
+typedef struct _KvaExtent {
+    /* 在规格空闲链表中的节点，描述符未使用时串在备用链表中 */
+    ListNode sizeTag;
+    uintptr_t start;
+    uint32_t pageCnt;
+    /* 起始、结束地址散列链，释放时据此找到相邻的空闲区间合并 */
+    struct _KvaExtent *startNext;
+    struct _KvaExtent *endNext;
+} KvaExtent;
+
+/* 内核虚拟地址区间分配器 */
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    /* 非空的一级规格位图，以及各一级规格下非空的二级规格位图 */
+    uint32_t flBitmap;
+    uint32_t slBitmap[KVA_FL_CNT];
+    List freeList[KVA_FL_CNT][KVA_SL_CNT];
+    KvaExtent *startHash[KVA_HASH_CNT];
+    KvaExtent *endHash[KVA_HASH_CNT];
+    /* 未使用的区间描述符 */
+    List spareList;
+    /* 空闲页数和空闲区间数 */
+    uint32_t freePages;
+    uint32_t extentCnt;
+} KvaPool;
+
+/* 以nodeBuf中的bufSize字节作为区间描述符，初始化管理[start, end)的分配器 */
+void Kva_Init(KvaPool *pool, uintptr_t start, uintptr_t end, void *nodeBuf, uint32_t bufSize);
+/* 分配pageCnt个连续虚拟页，失败返回NULL */
+uintptr_t Kva_Alloc(KvaPool *pool, uint32_t pageCnt);
+/* 预留指定地址开始的pageCnt个页，不是空闲地址时返回-1 */
+int32_t Kva_Reserve(KvaPool *pool, uintptr_t addr, uint32_t pageCnt);
+/* 归还从addr开始的pageCnt个页，并与相邻的空闲区间合并 */
+void Kva_Free(KvaPool *pool, uintptr_t addr, uint32_t pageCnt);
+
+#endif
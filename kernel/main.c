@@ -15,8 +15,13 @@
 #include "kernel/process.h"
 #include "kernel/tss.h"
 #include "kernel/syscall.h"
+#include "kernel/swap.h"
+#include "kernel/memprof.h"
 #include "fs/fs.h"
 #include "fs/file.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+#include "lib/umalloc.h"
 
 uint32_t g_procA = 0;
 uint32_t g_procB = 0;
@@ -25,6 +30,12 @@ void ThreadA_Test(void *args);
 void ThreadB_Test(void *args);
 void ProcessA_Test(void);
 void ProcessB_Test(void);
+void ProcessFork_Bench(void);
+void ProcessSyscall_Bench(void);
+void ProcessMalloc_Bench(void);
+void ProcessMemInfo_Show(void);
+void ThreadSwitchA_Bench(void *args);
+void ThreadSwitchB_Bench(void *args);
 
 int main()
 {
@@ -45,19 +56,31 @@ int main()
 	/* 任务初始化 */
     Thread_Init();
 
+	/* 启动页框预清0线程 */
+	Mem_ZeroInit();
+
 	TSS_Init();
 	Syscall_Init();
 		
 	Process_Create(ProcessA_Test, "Process_1");
 	//Process_Create(ProcessB_Test, "Process_2");
+	//Process_Create(ProcessFork_Bench, "fork_bench");
+	//Process_Create(ProcessSyscall_Bench, "syscall_bench");
+	//Process_Create(ProcessMalloc_Bench, "malloc_bench");
+	//Process_Create(ProcessMemInfo_Show, "meminfo");
 
 	Task *task1 = Thread_Create("test_1", 8,  ThreadA_Test, "Test_1 ");
 	//Task *task2 = Thread_Create("test_2", 32, ThreadB_Test, "Test_2 ");
+	//Thread_Create("switch_a", 31, ThreadSwitchA_Bench, NULL);
+	//Thread_Create("switch_b", 31, ThreadSwitchB_Bench, NULL);
 
 	/* 打开中断 */
 	Idt_IntrEnable();
 
 	Ide_Init();
+
+	/* 初始化交换分区 */
+	Swap_Init();
 	
 	FS_Init();
 
@@ -73,6 +96,11 @@ int main()
 	Console_PutInt(fd);
 	Console_PutStr(" closed now\n");
 
+#ifdef MEM_PROFILE
+	/* 打印文件系统初始化及读写过程中各调用点的内核堆使用情况 */
+	MemProf_Dump();
+#endif
+
 	init();
 
     return 0;
@@ -147,3 +175,182 @@ void ProcessB_Test(void)
 		
 	}
 }
+
+/* fork+exit性能测试，分别统计映射1、16、256个用户页时单次fork的耗时 */
+#define FORK_BENCH_ROUNDS 16
+void ProcessFork_Bench(void)
+{
+	static const uint32_t pageCnts[] = {1, 16, 256};
+	char buf[64];
+
+	for (uint32_t i = 0; i < sizeof(pageCnts) / sizeof(pageCnts[0]); i++) {
+		uint8_t *mem = malloc(pageCnts[i] * PAGE_SIZE);
+		if (mem == NULL) {
+			write(STDOUT_NO, "fork bench: malloc failed\n", 0);
+			break;
+		}
+
+		/* 逐页写入，保证页面都已映射 */
+		for (uint32_t page = 0; page < pageCnts[i]; page++) {
+			mem[page * PAGE_SIZE] = (uint8_t)page;
+		}
+
+		uint32_t cycles = 0;
+		for (uint32_t round = 0; round < FORK_BENCH_ROUNDS; round++) {
+			uint64_t start = Timer_ReadTsc();
+			pid_t pid = fork();
+			if (pid == 0) {
+				exit(0);
+			}
+			cycles += (uint32_t)(Timer_ReadTsc() - start);
+		}
+
+		sprintf(buf, "fork %d pages: %d ns\n", pageCnts[i], Timer_Tsc2Ns(cycles / FORK_BENCH_ROUNDS));
+		write(STDOUT_NO, buf, strlen(buf));
+
+		free(mem);
+	}
+
+	while (1) {
+
+	}
+}
+
+/* 系统调用性能测试，统计单次getpid的耗时 */
+#define SYSCALL_BENCH_ROUNDS 10000
+void ProcessSyscall_Bench(void)
+{
+	char buf[64];
+	uint64_t start = Timer_ReadTsc();
+	for (uint32_t round = 0; round < SYSCALL_BENCH_ROUNDS; round++) {
+		getpid();
+	}
+	uint32_t cycles = (uint32_t)(Timer_ReadTsc() - start);
+
+	sprintf(buf, "syscall: %d ns\n", Timer_Tsc2Ns(cycles / SYSCALL_BENCH_ROUNDS));
+	write(STDOUT_NO, buf, strlen(buf));
+
+	while (1) {
+
+	}
+}
+
+/* 内存分配性能测试，分别统计系统调用malloc/free与用户态umalloc/ufree每秒完成的分配释放次数 */
+#define MALLOC_BENCH_ROUNDS 10000
+void ProcessMalloc_Bench(void)
+{
+	static const uint32_t sizes[] = {32, 512, 1024};
+	char buf[64];
+
+	for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		uint64_t start = Timer_ReadTsc();
+		for (uint32_t round = 0; round < MALLOC_BENCH_ROUNDS; round++) {
+			free(malloc(sizes[i]));
+		}
+		uint32_t sysNs = Timer_Tsc2Ns((uint32_t)(Timer_ReadTsc() - start) / MALLOC_BENCH_ROUNDS);
+
+		start = Timer_ReadTsc();
+		for (uint32_t round = 0; round < MALLOC_BENCH_ROUNDS; round++) {
+			ufree(umalloc(sizes[i]));
+		}
+		uint32_t userNs = Timer_Tsc2Ns((uint32_t)(Timer_ReadTsc() - start) / MALLOC_BENCH_ROUNDS);
+
+		/* 换算成每秒完成的分配释放次数 */
+		sprintf(buf, "malloc %d bytes: syscall %d/s, umalloc %d/s\n", sizes[i],
+			1000000000 / (sysNs + 1), 1000000000 / (userNs + 1));
+		write(STDOUT_NO, buf, strlen(buf));
+	}
+
+	while (1) {
+
+	}
+}
+
+/* 打印meminfo系统调用返回的内存统计 */
+void ProcessMemInfo_Show(void)
+{
+	MemInfo info;
+	char buf[80];
+
+	if (meminfo(&info) == -1) {
+		write(STDOUT_NO, "meminfo failed\n", 0);
+		while (1) {
+
+		}
+	}
+
+	sprintf(buf, "kernel pages: total %d, used %d, free %d\n", info.kernelTotalPages,
+		info.kernelTotalPages - info.kernelFreePages, info.kernelFreePages);
+	write(STDOUT_NO, buf, strlen(buf));
+	sprintf(buf, "user pages: total %d, used %d, free %d\n", info.userTotalPages,
+		info.userTotalPages - info.userFreePages, info.userFreePages);
+	write(STDOUT_NO, buf, strlen(buf));
+	sprintf(buf, "page tables: %d pages\n", info.pageTablePages);
+	write(STDOUT_NO, buf, strlen(buf));
+
+	for (uint32_t idx = 0; idx < DESC_CNT; idx++) {
+		sprintf(buf, "heap %d: kernel arenas %d free %d, proc arenas %d free %d\n",
+			info.kernelHeap[idx].blockSize, info.kernelHeap[idx].arenaCnt, info.kernelHeap[idx].freeBlocks,
+			info.procHeap[idx].arenaCnt, info.procHeap[idx].freeBlocks);
+		write(STDOUT_NO, buf, strlen(buf));
+	}
+
+	CpuStat cpu;
+	if ((cpustat(&cpu) == 0) && (cpu.totalTicks >= 100)) {
+		sprintf(buf, "cpu: idle %d of %d ticks, busy %d percent\n", cpu.idleTicks, cpu.totalTicks,
+			(cpu.totalTicks - cpu.idleTicks) / (cpu.totalTicks / 100));
+		write(STDOUT_NO, buf, strlen(buf));
+	}
+
+	uint32_t taskCnt = (info.taskCnt < MEMINFO_TASK_MAX) ? info.taskCnt : MEMINFO_TASK_MAX;
+	for (uint32_t i = 0; i < taskCnt; i++) {
+		sprintf(buf, "task %d %s: rss %d pages\n", info.tasks[i].pid, info.tasks[i].name, info.tasks[i].rssPages);
+		write(STDOUT_NO, buf, strlen(buf));
+	}
+
+	while (1) {
+
+	}
+}
+
+/* 任务切换性能测试：switch_a让出CPU前记录时间戳，紧随其后的switch_b恢复运行时统计耗时
+ * 调度为轮转方式，a让出CPU时b总在就绪队列头部，每个样本都是一次直接的任务切换
+ */
+#define SWITCH_BENCH_ROUNDS 1000
+static volatile uint64_t g_switchStamp = 0;
+static volatile uint32_t g_switchCnt = 0;
+static uint32_t g_switchCycles = 0;
+
+void ThreadSwitchA_Bench(void *args)
+{
+	while (g_switchCnt < SWITCH_BENCH_ROUNDS) {
+		g_switchStamp = Timer_ReadTsc();
+		Thread_Yield();
+	}
+
+	while (1) {
+
+	}
+}
+
+void ThreadSwitchB_Bench(void *args)
+{
+	char buf[64];
+	while (g_switchCnt < SWITCH_BENCH_ROUNDS) {
+		Thread_Yield();
+
+		uint64_t now = Timer_ReadTsc();
+		if (g_switchStamp != 0) {
+			g_switchCycles += (uint32_t)(now - g_switchStamp);
+			g_switchStamp = 0;
+			g_switchCnt++;
+		}
+	}
+
+	sprintf(buf, "context switch: %d ns\n", Timer_Tsc2Ns(g_switchCycles / SWITCH_BENCH_ROUNDS));
+	Console_PutStr(buf);
+
+	while (1) {
+
+	}
+}
@@ -9,33 +9,123 @@
 #include "kernel/panic.h"
 #include "kernel/bitmap.h"
 #include "kernel/sync.h"
+#include "kernel/slab.h"
+#include "kernel/vma.h"
+#include "kernel/kva.h"
+#include "kernel/swap.h"
+#include "kernel/process.h"
 #include "kernel/interrupt.h"
 #include "kernel/global.h"
 #include "lib/print.h"
 #include "lib/string.h"
 
-/* 内存位图存放地址，选择该位置原因是：
+/* 内核虚拟地址位图存放地址，选择该位置原因是：
  * 0xc009f000为内核最大栈地址，
  * 预留4K地址（PCB） +  4 * 4K的位图空间（4K位图空间可表示128M内存，这里预估512M）
  * 所以 MEM_BITMAP_BASE = 0xc009f000 - 0x1000 - 0x4000 = 0xc009a000
+ * 物理内存池改用伙伴系统管理后，该区域只存放内核虚拟地址位图
+ * 内核虚拟地址改用区间分配器管理后，该区域存放空闲区间描述符
  */
 #define MEM_BITMAP_BASE 0xc009a000
 
 /* loader中计算到的物理内存大小存放路径 */
 #define MEM_TOTAL_SIZE_ADDR (0xb03)
-
-/* 虚拟内存池起始地址 */
+/* loader保存的e820内存布局表(ards_buf)及表项数(ards_nr)存放路径 */
+#define MEM_ARDS_ADDR       (0xb0d)
+#define MEM_ARDS_NR_ADDR    (0xc01)
+/* ards_buf最多存放的表项数，与loader中的ARDS_MAX一致 */
+#define MEM_ARDS_MAX        12
+/* 可供操作系统使用的内存类型 */
+#define MEM_ARDS_USABLE     1
+/* 只管理4G以内的物理内存 */
+#define MEM_MAX_PFN         0x000fffff
+
+/* 内核虚拟地址空闲区间描述符占用的字节数，即MEM_BITMAP_BASE处预留的4页 */
+#define MEM_KVA_NODE_LEN (4 * PAGE_SIZE)
+
+/* 虚拟内存池起始地址，不支持4M大页时使用 */
 #define K_HEAP_START 0xc0100000
 
+/* 内核直接映射区：从0xc0000000开始用4M大页线性映射物理内存 */
+#define K_DIRECT_MAP_BASE 0xc0000000
+#define K_DIRECT_MAP_MAX  (512 * 1024 * 1024)
+#define LARGE_PAGE_SIZE   (4 * 1024 * 1024)
+/* 内核虚拟地址上限，最后一个页目录项用于访问页目录表自身 */
+#define K_VIR_ADDR_END    0xffc00000
+
+/* cpuid功能位与cr4控制位 */
+#define CPUID_EDX_PSE 0x00000008
+#define CPUID_EDX_PGE 0x00002000
+#define CR4_PSE       0x00000010
+#define CR4_PGE       0x00000080
+
 /* 获取页目录项或页表项宏 */
 #define PDE_INDEX(addr) ((addr & 0xffc00000) >> 22)
 #define PTE_INDEX(addr) ((addr & 0x003ff000) >> 12)
 
-/* 物理内存池 */
+/* 用户空间占用的页目录项数，0xc0000000以上为内核空间 */
+#define USER_PDE_CNT 768
+
+/* 物理地址与页框号转换 */
+#define PHY2PFN(addr) ((uint32_t)(addr) >> 12)
+#define PFN2PHY(pfn)  ((uint32_t)(pfn) << 12)
+
+/* 页框描述符状态 */
+#define MEM_PAGE_FREE     0x01    /* 空闲块的首页，挂在伙伴空闲链表中 */
+#define MEM_PAGE_RESERVED 0x02    /* 不参与分配的页框，如页框描述符数组本身及内存空洞 */
+#define MEM_PAGE_USER     0x04    /* 页框当前归属用户物理内存池 */
+
+/* 每个内存池预清0页框数上限，以及唤醒清0线程补充的低水位 */
+#define MEM_ZERO_POOL_MAX 32
+#define MEM_ZERO_POOL_LOW 8
+/* 空闲页框不多于该值时不再预清0，留给正常分配 */
+#define MEM_ZERO_RESERVE  64
+/* 清0线程优先级，每次只运行1个时钟周期 */
+#define MEM_ZERO_PRIO     1
+
+/* 用户页框不足时最多换出后重试的次数 */
+#define MEM_SWAP_RETRY    4
+/* 同时写盘的交换槽数上限 */
+#define MEM_SWAP_IO_MAX   8
+
+/* 内存池耗尽时从另一个内存池迁移的最小块阶数，整块迁移避免来回拉锯 */
+#define MEM_MIGRATE_ORDER 8
+
+/* loader通过e820获取的内存布局表项 */
+typedef struct {
+    uint32_t baseLow;
+    uint32_t baseHigh;
+    uint32_t lengthLow;
+    uint32_t lengthHigh;
+    uint32_t type;
+} MemArds;
+
+/* 可用物理内存区间[startPfn, endPfn) */
+typedef struct {
+    uint32_t startPfn;
+    uint32_t endPfn;
+} MemRange;
+
+/* 物理内存池，使用二进制伙伴系统管理 */
 typedef struct {
-    Bitmap bitmap;
-    uint32_t phyAddrStart;
-    uint32_t poolSize;
+    /* 页框归属标记，用户物理内存池为MEM_PAGE_USER，内核为0 */
+    uint8_t pageTag;
+    /* 当前归属该内存池的页框数，会随页框迁移变化 */
+    uint32_t totalPages;
+    /* 从另一个内存池迁入的页框数 */
+    uint32_t migratePages;
+    /* 各阶空闲块链表，第k阶链表中每个块包含2^k个连续页框 */
+    List freeList[MEM_MAX_ORDER + 1];
+    /* 各阶空闲块数量 */
+    uint32_t freeCnt[MEM_MAX_ORDER + 1];
+    /* 空闲页框总数 */
+    uint32_t freePages;
+    /* 已清0的页框链表，页框已从伙伴系统中取出，通过freeTag串起来 */
+    List zeroList;
+    uint32_t zeroCnt;
+    /* 需要清0的单页分配命中和未命中预清0页框池的次数 */
+    uint32_t zeroHits;
+    uint32_t zeroMisses;
     Lock memLock;
 } MemPool;
 
@@ -44,94 +134,508 @@ MemPool kernelMemPool;
 /* 用户物理内存池 */
 MemPool userMemPool;
 
-/* 内核内存块描述符数组 */
-static MemBlockDesc kernelBlockDesc[DESC_CNT];
+/* 页框描述符数组，覆盖内核和用户物理内存池 */
+static MemPage *g_memPages;
+/* g_memPages[0]对应的页框号 */
+static uint32_t g_memPageBasePfn;
+/* 页框描述符个数，其中内存空洞对应的描述符被标记为保留 */
+static uint32_t g_memPageCnt;
+
+/* 按起始地址排序、互不重叠的可用物理内存区间 */
+static MemRange g_memRanges[MEM_ARDS_MAX];
+static uint32_t g_memRangeCnt;
+
+/* 页框预清0线程 */
+static Task *g_zeroTask;
+
+/* 直接映射区大小，不支持4M大页时为0 */
+static uint32_t g_directMapSize;
+/* 内核页表项附加的全局标志，不支持PGE时为0 */
+static uint32_t g_kernelPgGlobal;
 
 /* 内核虚拟地址内存池 */
-VirtualMemPool kernelVirMemPool;
+KvaPool kernelVirMemPool;
 
-/* 内存池初始化 */
-static void Mem_PoolInit(uint32_t allMemSize)
+/* 用户空间页表占用的页数 */
+static uint32_t g_pageTablePages;
+
+static void *Mem_GetVirAddr(VirMemType virMemtype, uint32_t pagesNums);
+static int32_t Mem_AddPageTable(void *virAddr, void *pagePhyAddr);
+
+/* 虚拟地址是否位于直接映射区 */
+static inline bool Mem_InDirectMap(uintptr_t virAddr)
 {
-    put_str("Mem_PoolInit start. \n");
+    return virAddr - K_DIRECT_MAP_BASE < g_directMapSize;
+}
 
-    /* 页目录(1) + 页表(框号为1) + 页表(框号769 ~ 1022 = 254个) = 256页被占用 */
-    uint32_t pageTableSize = 256 * PAGE_SIZE;
-    /* 0x100000表示1M低端内存 */
-    uint32_t usedMemSize = pageTableSize + 0x100000;
-    uint32_t freeMemSize = allMemSize - usedMemSize;
-    uint16_t allFreePages = freeMemSize / PAGE_SIZE;
-
-    /* 内核和用户平分所有可用的内存页 */
-    uint16_t kernelFreePages = allFreePages / 2;
-    uint16_t userFreePages = allFreePages - kernelFreePages;
-
-    /* 初始化内核物理内存池 */
-    kernelMemPool.bitmap.bitmapLen = kernelFreePages / 8;
-    kernelMemPool.bitmap.bitmap = (uint8_t *)MEM_BITMAP_BASE;
-    kernelMemPool.phyAddrStart = usedMemSize;
-    kernelMemPool.poolSize = kernelFreePages * PAGE_SIZE;
-    /* 将位图置0，表示内存未被使用 */
-    BitmapInit(&kernelMemPool.bitmap);
-    /* 初始化内存池锁 */
-    Lock_Init(&kernelMemPool.memLock);
-    
-    /* 初始化用户物理内存池 */
-    userMemPool.bitmap.bitmapLen = userFreePages / 8;
-    userMemPool.bitmap.bitmap = (uint8_t *)(MEM_BITMAP_BASE + kernelMemPool.bitmap.bitmapLen);
-    userMemPool.phyAddrStart = kernelMemPool.phyAddrStart + kernelMemPool.poolSize;
-    userMemPool.poolSize = userFreePages * PAGE_SIZE;
-    /* 将位图置0，表示内存未被使用 */
-    BitmapInit(&userMemPool.bitmap);
-    /* 初始化内存池锁 */
-    Lock_Init(&userMemPool.memLock);
+/* 物理地址转换为直接映射区中的虚拟地址，不在直接映射区内时返回NULL */
+void *Mem_P2V(uintptr_t phyAddr)
+{
+    if (phyAddr >= g_directMapSize) {
+        return NULL;
+    }
 
-    /* 打印物理内存划分情况 */
-    put_str("kernelMemPool.bitmap.bitmap: ");
-    put_int((uintptr_t)kernelMemPool.bitmap.bitmap);
-    put_str(" kernelMemPool.bitmap.bitmapLen: ");
-    put_int(kernelMemPool.bitmap.bitmapLen);
-    put_str(" kernelMemPool.phyAddrStart: ");
-    put_int(kernelMemPool.phyAddrStart);
-    put_str(" kernelMemPool.poolSize: ");
-    put_int(kernelMemPool.poolSize);
-    put_str("\n");
+    return (void *)(phyAddr + K_DIRECT_MAP_BASE);
+}
 
-    put_str("userMemPool.bitmap.bitmap: ");
-    put_int((uintptr_t)userMemPool.bitmap.bitmap);
-    put_str(" userMemPool.bitmap.bitmapLen: ");
-    put_int(userMemPool.bitmap.bitmapLen);
-    put_str(" userMemPool.phyAddrStart: ");
-    put_int(userMemPool.phyAddrStart);
-    put_str(" userMemPool.poolSize: ");
-    put_int(userMemPool.poolSize);
-    put_str("\n");
+/* 页框号转换为页框描述符 */
+static inline MemPage *Mem_Pfn2Page(uint32_t pfn)
+{
+    return &g_memPages[pfn - g_memPageBasePfn];
+}
 
-    /* 内核虚拟内存池初始化 */
-    kernelVirMemPool.bitmap.bitmapLen = kernelMemPool.bitmap.bitmapLen;
-    kernelVirMemPool.bitmap.bitmap = (uint8_t *)(MEM_BITMAP_BASE + kernelMemPool.bitmap.bitmapLen + userMemPool.bitmap.bitmapLen);
-    kernelVirMemPool.virtualAddrStart = K_HEAP_START;
-    /* 将位图置0，表示内存未被使用 */
-    BitmapInit(&kernelVirMemPool.bitmap);
+/* 页框描述符转换为页框号 */
+static inline uint32_t Mem_Page2Pfn(const MemPage *page)
+{
+    return (uint32_t)(page - g_memPages) + g_memPageBasePfn;
+}
 
-    put_str("Mem_PoolInit end, \n");
+/* 根据物理地址获取页框描述符 */
+MemPage *Mem_Phy2Page(uintptr_t phyAddr)
+{
+    return Mem_Pfn2Page(PHY2PFN(phyAddr));
+}
+
+/* 页框是否归属内存池，页框可以在两个内存池之间迁移，按页框描述符中的归属标记判断 */
+static inline bool Mem_PoolHasPfn(const MemPool *memPool, uint32_t pfn)
+{
+    if ((pfn < g_memPageBasePfn) || (pfn - g_memPageBasePfn >= g_memPageCnt)) {
+        return false;
+    }
+
+    return (Mem_Pfn2Page(pfn)->flags & MEM_PAGE_USER) == memPool->pageTag;
+}
+
+/* 将以pfn为首的2^order个页框作为空闲块挂入内存池 */
+static inline void Mem_BuddyAddFree(MemPool *memPool, uint32_t pfn, uint32_t order)
+{
+    MemPage *page = Mem_Pfn2Page(pfn);
+    page->flags = memPool->pageTag | MEM_PAGE_FREE;
+    page->order = order;
+    List_Push(&memPool->freeList[order], &page->freeTag);
+    memPool->freeCnt[order]++;
+    memPool->freePages += (1U << order);
+}
+
+/* 将空闲块从内存池中摘除 */
+static inline void Mem_BuddyDelFree(MemPool *memPool, MemPage *page)
+{
+    ASSERT(page->flags & MEM_PAGE_FREE);
+    List_Remove(&page->freeTag);
+    memPool->freeCnt[page->order]--;
+    memPool->freePages -= (1U << page->order);
+    page->flags &= ~MEM_PAGE_FREE;
+}
+
+static bool Mem_PoolMigrate(MemPool *memPool, uint32_t order);
+
+/* 从内存池中分配2^order个连续物理页，成功则返回物理地址，失败返回NULL */
+static void *Mem_PallocOrder(MemPool *memPool, uint32_t order)
+{
+    ASSERT(order <= MEM_MAX_ORDER);
+
+    /* 找到不小于order阶的最小空闲块 */
+    uint32_t currOrder = order;
+    while ((currOrder <= MEM_MAX_ORDER) && (memPool->freeCnt[currOrder] == 0)) {
+        currOrder++;
+    }
+
+    if (currOrder > MEM_MAX_ORDER) {
+        /* 本内存池没有足够大的空闲块，从另一个内存池迁入 */
+        if (!Mem_PoolMigrate(memPool, order)) {
+            return NULL;
+        }
+        currOrder = order;
+        while (memPool->freeCnt[currOrder] == 0) {
+            currOrder++;
+        }
+    }
+
+    MemPage *page = ELEM2ENTRY(MemPage, freeTag, memPool->freeList[currOrder].head.next);
+    Mem_BuddyDelFree(memPool, page);
+    uint32_t pfn = Mem_Page2Pfn(page);
+
+    /* 块比需要的大，逐级对半拆分，高地址的一半挂回低一阶的空闲链表 */
+    while (currOrder > order) {
+        currOrder--;
+        Mem_BuddyAddFree(memPool, pfn + (1U << currOrder), currOrder);
+    }
+
+    return (void *)PFN2PHY(pfn);
+}
+
+/* 将以pfn为首的2^order个页框归还内存池，并与空闲的伙伴块逐级合并 */
+static void Mem_PfreeBlock(MemPool *memPool, uint32_t pfn, uint32_t order)
+{
+    while (order < MEM_MAX_ORDER) {
+        uint32_t buddyPfn = pfn ^ (1U << order);
+        if (!Mem_PoolHasPfn(memPool, buddyPfn)) {
+            break;
+        }
+
+        MemPage *buddy = Mem_Pfn2Page(buddyPfn);
+        if (!(buddy->flags & MEM_PAGE_FREE) || (buddy->order != order)) {
+            break;
+        }
+
+        /* 伙伴空闲，合并成高一阶的块 */
+        Mem_BuddyDelFree(memPool, buddy);
+        pfn &= ~(1U << order);
+        order++;
+    }
+
+    Mem_BuddyAddFree(memPool, pfn, order);
+}
+
+/* 将单个物理页归还内存池 */
+static void Mem_PfreePfn(MemPool *memPool, uint32_t pfn)
+{
+    ASSERT(Mem_PoolHasPfn(memPool, pfn));
+    /* 只能释放已经分配的物理页 */
+    ASSERT((Mem_Pfn2Page(pfn)->flags & (MEM_PAGE_FREE | MEM_PAGE_RESERVED)) == 0);
+
+    Mem_PfreeBlock(memPool, pfn, 0);
+}
+
+/* 获取另一个内存池的锁，锁被其他任务持有时不等待，避免两个内存池互相等锁 */
+static bool Mem_PoolTryLock(MemPool *memPool)
+{
+    IntrStatus oldStatus = Idt_IntrDisable();
+    if ((memPool->memLock.value == 0) && (memPool->memLock.holder != Thread_GetRunningTask())) {
+        Idt_SetIntrStatus(oldStatus);
+        return false;
+    }
+    Lock_Lock(&memPool->memLock);
+    Idt_SetIntrStatus(oldStatus);
+
+    return true;
+}
+
+/* 从另一个内存池迁入一个不小于order阶的空闲块，调用者持有memPool的锁 */
+static bool Mem_PoolMigrate(MemPool *memPool, uint32_t order)
+{
+    MemPool *srcPool = (memPool == &kernelMemPool) ? &userMemPool : &kernelMemPool;
+    if (!Mem_PoolTryLock(srcPool)) {
+        return false;
+    }
+
+    /* 优先迁移不小于MEM_MIGRATE_ORDER阶的块，没有时再退而求其次取最大的块 */
+    uint32_t srcOrder = (order > MEM_MIGRATE_ORDER) ? order : MEM_MIGRATE_ORDER;
+    while ((srcOrder <= MEM_MAX_ORDER) && (srcPool->freeCnt[srcOrder] == 0)) {
+        srcOrder++;
+    }
+    if (srcOrder > MEM_MAX_ORDER) {
+        srcOrder = (order > MEM_MIGRATE_ORDER) ? order : MEM_MIGRATE_ORDER;
+        while ((srcOrder > order) && (srcPool->freeCnt[srcOrder] == 0)) {
+            srcOrder--;
+        }
+        if ((srcOrder > MEM_MAX_ORDER) || (srcPool->freeCnt[srcOrder] == 0)) {
+            Lock_UnLock(&srcPool->memLock);
+            return false;
+        }
+    }
+
+    MemPage *page = ELEM2ENTRY(MemPage, freeTag, srcPool->freeList[srcOrder].head.next);
+    Mem_BuddyDelFree(srcPool, page);
+    uint32_t pageCnt = 1U << srcOrder;
+    srcPool->totalPages -= pageCnt;
+    Lock_UnLock(&srcPool->memLock);
+
+    /* 修改块内所有页框的归属标记，之后按页释放时才能找到正确的内存池 */
+    for (uint32_t i = 0; i < pageCnt; i++) {
+        page[i].flags = (page[i].flags & ~MEM_PAGE_USER) | memPool->pageTag;
+    }
+    memPool->totalPages += pageCnt;
+    memPool->migratePages += pageCnt;
+    Mem_PfreeBlock(memPool, Mem_Page2Pfn(page), srcOrder);
+
+    return true;
 }
 
-static inline uintptr_t Mem_GetVirAddrFromBitmap(Bitmap *bitmap, uint32_t pagesNums, uint32_t virtualAddrStart)
+/* 从内存池中分配pageCnt个物理地址连续的页，成功则返回物理地址，失败返回NULL */
+static void *Mem_PallocContig(MemPool *memPool, uint32_t pageCnt)
 {
-    /* 通过位图找到合适的空间 */
-    int32_t startBitIndex = BitmapScan(bitmap, pagesNums);
-    /* 找不到n个可用的连续虚拟页 */
-    if (startBitIndex == -1) {
+    uint32_t order = 0;
+    while ((1U << order) < pageCnt) {
+        order++;
+    }
+
+    if (order > MEM_MAX_ORDER) {
+        return NULL;
+    }
+
+    void *pagePhyAddr = Mem_PallocOrder(memPool, order);
+    if (pagePhyAddr == NULL) {
         return NULL;
     }
 
-    /* 从startBitIndex开始，将pagesNums位bit置1，表示已被占用 */
-    for (uint32_t i = 0; i < pagesNums; i++) {
-        BitmapSet(&kernelVirMemPool.bitmap, startBitIndex + i, 1);
+    /* 多余的尾部按对齐的最大块归还，这些块的伙伴都在已分配部分中，无需合并 */
+    uint32_t pfn = PHY2PFN(pagePhyAddr);
+    uint32_t idx = pageCnt;
+    while (idx < (1U << order)) {
+        uint32_t tailOrder = 0;
+        while (((idx & (1U << tailOrder)) == 0) && (idx + (2U << tailOrder) <= (1U << order))) {
+            tailOrder++;
+        }
+        Mem_BuddyAddFree(memPool, pfn + idx, tailOrder);
+        idx += (1U << tailOrder);
+    }
+
+    return pagePhyAddr;
+}
+
+/* 从内存池中取出一段不超过maxCnt页的物理连续页框，runCnt返回实际页数，失败返回NULL */
+static void *Mem_PallocRun(MemPool *memPool, uint32_t maxCnt, uint32_t *runCnt)
+{
+    uint32_t order = 0;
+    while ((order < MEM_MAX_ORDER) && ((2U << order) <= maxCnt)) {
+        order++;
+    }
+
+    /* 没有不小于order阶的空闲块时，退而取本内存池中最大的空闲块，避免拆成单页 */
+    uint32_t currOrder = order;
+    while ((currOrder <= MEM_MAX_ORDER) && (memPool->freeCnt[currOrder] == 0)) {
+        currOrder++;
+    }
+    if (currOrder > MEM_MAX_ORDER) {
+        while ((order > 0) && (memPool->freeCnt[order] == 0)) {
+            order--;
+        }
+    }
+
+    void *pagePhyAddr = Mem_PallocOrder(memPool, order);
+    if (pagePhyAddr != NULL) {
+        *runCnt = 1U << order;
+    }
+
+    return pagePhyAddr;
+}
+
+/* 将从phyAddr开始的pageCnt个页框逐页归还内存池 */
+static void Mem_PfreeRun(MemPool *memPool, uintptr_t phyAddr, uint32_t pageCnt)
+{
+    for (uint32_t i = 0; i < pageCnt; i++) {
+        Mem_PfreePfn(memPool, PHY2PFN(phyAddr) + i);
+    }
+}
+
+/* 初始化空的内存池 */
+static void Mem_BuddyInit(MemPool *memPool, uint8_t pageTag)
+{
+    for (uint32_t order = 0; order <= MEM_MAX_ORDER; order++) {
+        List_Init(&memPool->freeList[order]);
+        memPool->freeCnt[order] = 0;
+    }
+    memPool->pageTag = pageTag;
+    memPool->totalPages = 0;
+    memPool->migratePages = 0;
+    memPool->freePages = 0;
+    List_Init(&memPool->zeroList);
+    memPool->zeroCnt = 0;
+    memPool->zeroHits = 0;
+    memPool->zeroMisses = 0;
+    Lock_Init(&memPool->memLock);
+}
+
+/* 将[startPfn, endPfn)划分为尽可能大的对齐块挂入内存池 */
+static void Mem_BuddyAddRange(MemPool *memPool, uint32_t startPfn, uint32_t endPfn)
+{
+    for (uint32_t pfn = startPfn; pfn < endPfn; pfn++) {
+        Mem_Pfn2Page(pfn)->flags = memPool->pageTag;
+    }
+    memPool->totalPages += endPfn - startPfn;
+
+    uint32_t pfn = startPfn;
+    while (pfn < endPfn) {
+        uint32_t order = MEM_MAX_ORDER;
+        while ((pfn & ((1U << order) - 1)) || (pfn + (1U << order) > endPfn)) {
+            order--;
+        }
+        Mem_BuddyAddFree(memPool, pfn, order);
+        pfn += (1U << order);
+    }
+}
+
+/* 打印内存池各阶空闲块数量 */
+static void Mem_PoolPrint(const char *name, const MemPool *memPool)
+{
+    put_str(name);
+    put_str(" totalPages: ");
+    put_int(memPool->totalPages);
+    put_str(" migratePages: ");
+    put_int(memPool->migratePages);
+    put_str(" freePages: ");
+    put_int(memPool->freePages);
+    put_str(" zeroPages: ");
+    put_int(memPool->zeroCnt);
+    put_str("\n    free blocks per order:");
+    for (uint32_t order = 0; order <= MEM_MAX_ORDER; order++) {
+        put_str(" ");
+        put_int(memPool->freeCnt[order]);
+    }
+    put_str("\n");
+}
+
+/* 解析loader保存的e820内存布局表，得到按地址排序、互不重叠的可用物理内存区间 */
+static void Mem_RangeInit(void)
+{
+    uint32_t ardsNr = *(uint16_t *)MEM_ARDS_NR_ADDR;
+    const MemArds *ards = (const MemArds *)MEM_ARDS_ADDR;
+    if (ardsNr > MEM_ARDS_MAX) {
+        ardsNr = MEM_ARDS_MAX;
+    }
+
+    g_memRangeCnt = 0;
+    for (uint32_t i = 0; i < ardsNr; i++) {
+        /* 只使用4G以内的可用内存 */
+        if ((ards[i].type != MEM_ARDS_USABLE) || (ards[i].baseHigh != 0)) {
+            continue;
+        }
+
+        uint32_t startPfn = PHY2PFN(ards[i].baseLow) + ((ards[i].baseLow & 0x00000fff) != 0);
+        uint32_t endPfn = MEM_MAX_PFN;
+        uint32_t endAddr = ards[i].baseLow + ards[i].lengthLow;
+        if ((ards[i].lengthHigh == 0) && (endAddr >= ards[i].baseLow)) {
+            endPfn = PHY2PFN(endAddr);
+        }
+        if (endPfn > MEM_MAX_PFN) {
+            endPfn = MEM_MAX_PFN;
+        }
+        if (startPfn >= endPfn) {
+            continue;
+        }
+
+        /* 按起始页框号插入排序 */
+        uint32_t j = g_memRangeCnt;
+        while ((j > 0) && (g_memRanges[j - 1].startPfn > startPfn)) {
+            g_memRanges[j] = g_memRanges[j - 1];
+            j--;
+        }
+        g_memRanges[j].startPfn = startPfn;
+        g_memRanges[j].endPfn = endPfn;
+        g_memRangeCnt++;
+    }
+
+    /* 裁掉区间之间重叠的部分 */
+    uint32_t cnt = 0;
+    for (uint32_t i = 0; i < g_memRangeCnt; i++) {
+        MemRange range = g_memRanges[i];
+        if ((cnt > 0) && (range.startPfn < g_memRanges[cnt - 1].endPfn)) {
+            range.startPfn = g_memRanges[cnt - 1].endPfn;
+        }
+        if (range.startPfn < range.endPfn) {
+            g_memRanges[cnt++] = range;
+        }
+    }
+    g_memRangeCnt = cnt;
+
+    /* e820获取失败时loader将ards_nr清0，只能使用e801/88获取到的总内存大小 */
+    if (g_memRangeCnt == 0) {
+        g_memRanges[0].startPfn = 0;
+        g_memRanges[0].endPfn = PHY2PFN(*(uint32_t *)MEM_TOTAL_SIZE_ADDR);
+        g_memRangeCnt = 1;
+    }
+
+    for (uint32_t i = 0; i < g_memRangeCnt; i++) {
+        put_str("usable memory: ");
+        put_int(PFN2PHY(g_memRanges[i].startPfn));
+        put_str(" - ");
+        put_int(PFN2PHY(g_memRanges[i].endPfn));
+        put_str("\n");
+    }
+}
+
+/* 内存池初始化 */
+static void Mem_PoolInit(void)
+{
+    put_str("Mem_PoolInit start. \n");
+
+    /* 页目录(1) + 页表(框号为1) + 页表(框号769 ~ 1022 = 254个) = 256页被占用 */
+    uint32_t pageTableSize = 256 * PAGE_SIZE;
+    /* 0x100000表示1M低端内存 */
+    uint32_t usedMemSize = pageTableSize + 0x100000;
+    uint32_t basePfn = PHY2PFN(usedMemSize);
+
+    /* 裁掉已被占用的低端内存，统计可用页框 */
+    uint32_t allFreePages = 0;
+    for (uint32_t i = 0; i < g_memRangeCnt; i++) {
+        MemRange *range = &g_memRanges[i];
+        if (range->startPfn < basePfn) {
+            range->startPfn = (range->endPfn > basePfn) ? basePfn : range->endPfn;
+        }
+        allFreePages += range->endPfn - range->startPfn;
+    }
+    ASSERT(allFreePages > 0);
+
+    /* 页框描述符数组覆盖从basePfn到最高可用页框，空洞部分的描述符标记为保留 */
+    g_memPageBasePfn = basePfn;
+    g_memPageCnt = g_memRanges[g_memRangeCnt - 1].endPfn - basePfn;
+    uint32_t metaPages = DIV_ROUND_UP(g_memPageCnt * sizeof(MemPage), PAGE_SIZE);
+
+    /* 页框描述符数组放在第一个足够大的可用区间开头 */
+    MemRange *metaRange = NULL;
+    for (uint32_t i = 0; i < g_memRangeCnt; i++) {
+        if (g_memRanges[i].endPfn - g_memRanges[i].startPfn > metaPages) {
+            metaRange = &g_memRanges[i];
+            break;
+        }
+    }
+    ASSERT(metaRange != NULL);
+    uint32_t metaPfn = metaRange->startPfn;
+    metaRange->startPfn += metaPages;
+    allFreePages -= metaPages;
+
+    Mem_BuddyInit(&kernelMemPool, 0);
+    Mem_BuddyInit(&userMemPool, MEM_PAGE_USER);
+
+    /* 内核虚拟内存池初始化，存在直接映射区时内核堆放在其后，
+     * 页框可以迁移，内核最多可以使用全部可用页框
+     */
+    uintptr_t heapStart = (g_directMapSize != 0) ? K_DIRECT_MAP_BASE + g_directMapSize : K_HEAP_START;
+    uint32_t heapPages = allFreePages;
+    if (heapPages > (K_VIR_ADDR_END - heapStart) / PAGE_SIZE) {
+        heapPages = (K_VIR_ADDR_END - heapStart) / PAGE_SIZE;
+    }
+    Kva_Init(&kernelVirMemPool, heapStart, heapStart + heapPages * PAGE_SIZE, (void *)MEM_BITMAP_BASE, MEM_KVA_NODE_LEN);
+
+    /* 页框描述符数组优先通过直接映射区访问，超出直接映射区时映射到内核堆起始处 */
+    if (metaPfn + metaPages <= PHY2PFN(g_directMapSize)) {
+        g_memPages = Mem_P2V(PFN2PHY(metaPfn));
+    } else {
+        g_memPages = Mem_GetVirAddr(VIR_MEM_KERNEL, metaPages);
+        ASSERT(g_memPages != NULL);
+        for (uint32_t i = 0; i < metaPages; i++) {
+            if (Mem_AddPageTable((void *)((uintptr_t)g_memPages + i * PAGE_SIZE), (void *)PFN2PHY(metaPfn + i)) == -1) {
+                PANIC("Mem_Init: map page descriptors failed!");
+            }
+        }
     }
+    memset(g_memPages, 0, g_memPageCnt * sizeof(MemPage));
+    for (uint32_t i = 0; i < g_memPageCnt; i++) {
+        g_memPages[i].flags = MEM_PAGE_RESERVED;
+    }
+
+    /* 内核和用户初始时平分所有可用的内存页，低地址部分归内核，之后按需迁移 */
+    uint32_t kernelFreePages = allFreePages / 2;
+    for (uint32_t i = 0; i < g_memRangeCnt; i++) {
+        uint32_t startPfn = g_memRanges[i].startPfn;
+        uint32_t endPfn = g_memRanges[i].endPfn;
+        if (kernelFreePages > 0) {
+            uint32_t kernelEndPfn = (endPfn - startPfn > kernelFreePages) ? startPfn + kernelFreePages : endPfn;
+            Mem_BuddyAddRange(&kernelMemPool, startPfn, kernelEndPfn);
+            kernelFreePages -= kernelEndPfn - startPfn;
+            startPfn = kernelEndPfn;
+        }
+        if (startPfn < endPfn) {
+            Mem_BuddyAddRange(&userMemPool, startPfn, endPfn);
+        }
+    }
+
+    /* 打印物理内存划分情况 */
+    Mem_PoolPrint("kernelMemPool", &kernelMemPool);
+    Mem_PoolPrint("userMemPool", &userMemPool);
 
-    return virtualAddrStart + startBitIndex * PAGE_SIZE;
+    put_str("Mem_PoolInit end, \n");
 }
 
 /* 分配n个连续虚拟页，成功返回虚拟地址，失败者返回NULL */
@@ -140,11 +644,11 @@ static void *Mem_GetVirAddr(VirMemType virMemtype, uint32_t pagesNums)
     uintptr_t virAddr = NULL;
 
     if (virMemtype == VIR_MEM_KERNEL) {
-        virAddr = Mem_GetVirAddrFromBitmap(&kernelVirMemPool.bitmap, pagesNums, kernelVirMemPool.virtualAddrStart);
+        virAddr = Kva_Alloc(&kernelVirMemPool, pagesNums);
     } else {
-        /* 分配用户虚拟地址 */
+        /* 在进程虚拟地址空间中预留一段区域 */
         Task *currTask = Thread_GetRunningTask();
-        virAddr = Mem_GetVirAddrFromBitmap(&currTask->progVaddrPool.bitmap, pagesNums, currTask->progVaddrPool.virtualAddrStart);
+        virAddr = Vma_Alloc(&currTask->vmaSpace, pagesNums * PAGE_SIZE, VMA_HEAP);
     }
 
     return (void *)virAddr;
@@ -170,22 +674,72 @@ uint32_t *Mem_GetVirAddrPtePtr(uintptr_t virAddr)
     return pte;
 }
 
+/* 唤醒页框预清0线程 */
+static void Mem_ZeroWakeup(void)
+{
+    IntrStatus oldStatus = Idt_IntrDisable();
+    if ((g_zeroTask != NULL) && (g_zeroTask->taskStatus == TASK_BLOCKED)) {
+        Thread_UnBlock(g_zeroTask);
+    }
+    Idt_SetIntrStatus(oldStatus);
+}
+
+/* 从预清0页框池中取出一个页框，调用者持有内存池的锁，池空返回NULL */
+static void *Mem_ZeroPoolPop(MemPool *memPool)
+{
+    if (memPool->zeroCnt == 0) {
+        return NULL;
+    }
+
+    MemPage *page = ELEM2ENTRY(MemPage, freeTag, List_Pop(&memPool->zeroList));
+    memPool->zeroCnt--;
+    if (memPool->zeroCnt < MEM_ZERO_POOL_LOW) {
+        Mem_ZeroWakeup();
+    }
+
+    return (void *)PFN2PHY(Mem_Page2Pfn(page));
+}
+
 /* 从物理内存中分配一个物理页，成功则返回物理地址，失败返回NULL */
 static void *Mem_Palloc(MemPool *memPool)
 {
-    /* 从位图中获取一个可用的bit */
-    int32_t bitIndex = BitmapScan(&(memPool->bitmap), 1);
-    if (bitIndex == -1) {
+    void *pagePhyAddr = Mem_PallocOrder(memPool, 0);
+    /* 伙伴系统耗尽时动用预清0页框池 */
+    if (pagePhyAddr == NULL) {
+        pagePhyAddr = Mem_ZeroPoolPop(memPool);
+    }
+
+    return pagePhyAddr;
+}
+
+/* 分配一个清0的物理页，优先使用预清0页框池，调用者持有内存池的锁 */
+static void *Mem_PallocZero(MemPool *memPool)
+{
+    void *pagePhyAddr = Mem_ZeroPoolPop(memPool);
+    if (pagePhyAddr != NULL) {
+        memPool->zeroHits++;
+        return pagePhyAddr;
+    }
+
+    pagePhyAddr = Mem_PallocOrder(memPool, 0);
+    if (pagePhyAddr == NULL) {
+        return NULL;
+    }
+
+    void *virAddr = Mem_Kmap((uintptr_t)pagePhyAddr);
+    if (virAddr == NULL) {
+        Mem_PfreePfn(memPool, PHY2PFN(pagePhyAddr));
         return NULL;
     }
+    memset(virAddr, 0, PAGE_SIZE);
+    Mem_Kunmap(virAddr);
+    memPool->zeroMisses++;
 
-    BitmapSet(&(memPool->bitmap), bitIndex, 1);
-    uint32_t pagePhyAddr = memPool->phyAddrStart + bitIndex * PAGE_SIZE;
-    return (void *)pagePhyAddr;
+    return pagePhyAddr;
 }
 
-/* 页表中添加虚拟地址virAddr与物理地址pagePhyAddr的映射 */
-static void Mem_AddPageTable(void *virAddr, void *pagePhyAddr)
+/* 页表中添加虚拟地址virAddr与物理地址pagePhyAddr的映射，无法分配页表时返回-1 */
+static int32_t Mem_AddPageTable(void *virAddr, void *pagePhyAddr)
 {
     uint32_t virAddrTmp = (uint32_t)virAddr;
     uint32_t pagePhyAddrTmp = (uint32_t)pagePhyAddr;
@@ -193,59 +747,149 @@ static void Mem_AddPageTable(void *virAddr, void *pagePhyAddr)
     uint32_t *pde = Mem_GetVirAddrPdePtr(virAddrTmp);
     uint32_t *pte = Mem_GetVirAddrPtePtr(virAddrTmp);
 
+    /* 内核空间的映射被所有任务共享，标记为全局页 */
+    uint32_t pteFlags = PG_US_U | PG_RW_W | PG_P_1;
+    if (PDE_INDEX(virAddrTmp) >= USER_PDE_CNT) {
+        pteFlags |= g_kernelPgGlobal;
+    }
+
     /* 通过P位判断是否页目录项是否存在 */
     if ((*pde) & 0x00000001) {
+        ASSERT(!((*pde) & PG_PS));
         /* 如果页表也已经被占用，则系统出错 */
         ASSERT(!((*pte) & 0x00000001));
         /* 设置页表属性 */
-        *pte = (pagePhyAddrTmp | PG_US_U | PG_RW_W | PG_P_1);
+        *pte = (pagePhyAddrTmp | pteFlags);
     } else {
-        /* 页目录项不存在，先创建页表映射，用户进程的页目录表也存放在内核内存池中 */
+        /* 页目录项不存在，先创建页表映射，用户进程的页目录表也存放在内核内存池中，
+         * 缺页异常等路径只持有用户内存池的锁，分配页表时需要持有内核内存池的锁 */
+        Lock_Lock(&kernelMemPool.memLock);
         uint32_t pdePhyAddr = (uint32_t)Mem_Palloc(&kernelMemPool);
-        ASSERT(pagePhyAddr != NULL);
+        Lock_UnLock(&kernelMemPool.memLock);
+        if (pdePhyAddr == NULL) {
+            return -1;
+        }
 
         /* 设置页目录项物理地址和属性 */
         *pde = (pdePhyAddr | PG_US_U | PG_RW_W | PG_P_1);
+        if (PDE_INDEX(virAddrTmp) < USER_PDE_CNT) {
+            g_pageTablePages++;
+        }
         /* 清空页表，此处不能memset(pdePhyAddr, 0, PAGE_SIZE), 因为pdePhyAddr是物理地址，需要使用其对应的虚拟地址 */
         memset((void *)((uintptr_t)pte & 0xfffff000), 0, PAGE_SIZE);
 
         ASSERT(!((*pte) & 0x00000001));
 
-        *pte = (pagePhyAddrTmp | PG_US_U | PG_RW_W | PG_P_1);
+        *pte = (pagePhyAddrTmp | pteFlags);
     }
 
-    return;
+    return 0;
  }
 
+/* 将[virAddr, virAddr + pageCnt页)映射到从phyAddr开始的连续物理页，
+ * 每4M只查找一次页目录项，失败时撤销本次建立的映射并返回-1
+ */
+static int32_t Mem_MapRange(uintptr_t virAddr, uintptr_t phyAddr, uint32_t pageCnt)
+{
+    uint32_t pteFlags = PG_US_U | PG_RW_W | PG_P_1;
+    if (PDE_INDEX(virAddr) >= USER_PDE_CNT) {
+        pteFlags |= g_kernelPgGlobal;
+    }
+
+    uint32_t doneCnt = 0;
+    while (doneCnt < pageCnt) {
+        uintptr_t addr = virAddr + doneCnt * PAGE_SIZE;
+        uint32_t *pde = Mem_GetVirAddrPdePtr(addr);
+        uint32_t *pte = Mem_GetVirAddrPtePtr(addr);
+
+        if (!(*pde & PG_P_1)) {
+            uint32_t ptPhyAddr = (uint32_t)Mem_Palloc(&kernelMemPool);
+            if (ptPhyAddr == NULL) {
+                /* 新建立的映射还未被访问过，TLB中不会有缓存，直接清除页表项即可 */
+                while (doneCnt > 0) {
+                    doneCnt--;
+                    *Mem_GetVirAddrPtePtr(virAddr + doneCnt * PAGE_SIZE) = 0;
+                }
+                return -1;
+            }
+            *pde = ptPhyAddr | PG_US_U | PG_RW_W | PG_P_1;
+            memset((void *)((uintptr_t)pte & 0xfffff000), 0, PAGE_SIZE);
+            if (PDE_INDEX(addr) < USER_PDE_CNT) {
+                g_pageTablePages++;
+            }
+        }
+
+        /* 当前页表中剩余的页表项一次写完 */
+        uint32_t cnt = 1024 - PTE_INDEX(addr);
+        if (cnt > pageCnt - doneCnt) {
+            cnt = pageCnt - doneCnt;
+        }
+        for (uint32_t i = 0; i < cnt; i++) {
+            ASSERT(!(pte[i] & PG_P_1));
+            pte[i] = (phyAddr + (doneCnt + i) * PAGE_SIZE) | pteFlags;
+        }
+        doneCnt += cnt;
+    }
+
+    return 0;
+}
+
 /* 分配n个页空间，成功则返回虚拟地址，失败时返回NULL */
 void *Mem_MallocPages(VirMemType virMemType, uint32_t pageNum)
 {
     ASSERT(pageNum > 0);
 
-    void *virAddrStart = Mem_GetVirAddr(virMemType, pageNum);
-    if (virAddrStart == NULL) {
-        return NULL;
+    /* 用户空间只预留虚拟地址，页框在首次访问时由缺页异常分配 */
+    if (virMemType == VIR_MEM_USER) {
+        return Mem_GetVirAddr(virMemType, pageNum);
     }
 
-    void *virAddrStartTmp = virAddrStart;
+    ASSERT(virMemType == VIR_MEM_KERNEL);
+    MemPool *memPool = &kernelMemPool;
 
-    MemPool *memPool = NULL;
-    if (virMemType == VIR_MEM_KERNEL) {
-        memPool = &kernelMemPool;
-    } else if (virMemType == VIR_MEM_USER) {
-        memPool = &userMemPool;
+    /* 物理页不足时，先回收堆中保留的全空arena */
+    if (memPool->freePages < pageNum) {
+        Mem_Reclaim(virMemType);
     }
 
-    ASSERT(memPool != NULL);
+    /* 优先分配物理地址连续的页框，整段落在直接映射区内时虚拟地址直接换算得到，无需修改页表 */
+    void *pagePhyAddr = Mem_PallocContig(memPool, pageNum);
+    if ((pagePhyAddr != NULL) && ((uintptr_t)pagePhyAddr + pageNum * PAGE_SIZE <= g_directMapSize)) {
+        return Mem_P2V((uintptr_t)pagePhyAddr);
+    }
 
-    while (pageNum--) {
-        void *pagePhyAddr = Mem_Palloc(memPool);
-        if (pagePhyAddr == NULL) {
-            return NULL;
+    /* 找不到连续页框或页框超出直接映射区时，在内核堆中分配虚拟地址并按段建立映射 */
+    void *virAddrStart = Mem_GetVirAddr(virMemType, pageNum);
+    if (virAddrStart == NULL) {
+        if (pagePhyAddr != NULL) {
+            Mem_PfreeRun(memPool, (uintptr_t)pagePhyAddr, pageNum);
+        }
+        return NULL;
+    }
+
+    /* 每次取一段物理连续的页框，整段一次性写入页表项 */
+    uint32_t mappedCnt = 0;
+    while (mappedCnt < pageNum) {
+        uint32_t runCnt = pageNum;
+        void *runPhyAddr = pagePhyAddr;
+        if (runPhyAddr == NULL) {
+            runPhyAddr = Mem_PallocRun(memPool, pageNum - mappedCnt, &runCnt);
+            if (runPhyAddr == NULL) {
+                break;
+            }
+        }
+
+        if (Mem_MapRange((uintptr_t)virAddrStart + mappedCnt * PAGE_SIZE, (uintptr_t)runPhyAddr, runCnt) == -1) {
+            Mem_PfreeRun(memPool, (uintptr_t)runPhyAddr, runCnt);
+            break;
         }
+        mappedCnt += runCnt;
+    }
 
-        Mem_AddPageTable(virAddrStartTmp, pagePhyAddr);
-        virAddrStartTmp += PAGE_SIZE;
+    /* 部分失败时回滚：释放已映射的页框和全部虚拟地址，未映射的页会被跳过 */
+    if (mappedCnt < pageNum) {
+        Mem_Free(virMemType, virAddrStart, pageNum);
+        return NULL;
     }
 
     return virAddrStart;
@@ -264,17 +908,20 @@ void *Mem_GetOnePage(VirMemType virMemType, uintptr_t virAddrStart)
     Lock_Lock(&memPool->memLock); 
 
     Task *curTask = Thread_GetRunningTask();
-    int32_t bitIndex = -1;
     /* 用户进程修改用户进程自己虚拟内存池 */
     if ((curTask->pgDir != NULL) && (virMemType == VIR_MEM_USER)) {
-        bitIndex = ((uintptr_t)virAddrStart - curTask->progVaddrPool.virtualAddrStart) / PAGE_SIZE;
-        ASSERT(bitIndex > 0);
-        BitmapSet(&curTask->progVaddrPool.bitmap, bitIndex, 1);
+        /* 同一页可能已被相邻的段预留 */
+        if ((Vma_Find(&curTask->vmaSpace, virAddrStart) == NULL) &&
+            (Vma_Insert(&curTask->vmaSpace, virAddrStart & 0xfffff000, PAGE_SIZE, VMA_FIXED) == -1)) {
+            Lock_UnLock(&memPool->memLock);
+            return NULL;
+        }
     } else if ((curTask->pgDir == NULL) && (virMemType == VIR_MEM_KERNEL)) {
         /* 内核线程修改内核虚拟内存池 */
-        bitIndex = ((uintptr_t)virAddrStart - kernelVirMemPool.virtualAddrStart) / PAGE_SIZE;
-        ASSERT(bitIndex > 0);
-        BitmapSet(&kernelVirMemPool.bitmap, bitIndex, 1);
+        if (Kva_Reserve(&kernelVirMemPool, virAddrStart & 0xfffff000, 1) == -1) {
+            Lock_UnLock(&memPool->memLock);
+            return NULL;
+        }
     } else {
         /* 出错 */
         PANIC("GetOnePage Failed!");
@@ -287,7 +934,14 @@ void *Mem_GetOnePage(VirMemType virMemType, uintptr_t virAddrStart)
         return NULL;
     }
 
-    Mem_AddPageTable((void *)virAddrStart, pagePhyAddr);
+    if (Mem_AddPageTable((void *)virAddrStart, pagePhyAddr) == -1) {
+        Mem_PfreePfn(memPool, PHY2PFN(pagePhyAddr));
+        Lock_UnLock(&memPool->memLock);
+        return NULL;
+    }
+    if (virMemType == VIR_MEM_USER) {
+        curTask->rssPages++;
+    }
 
     Lock_UnLock(&memPool->memLock);
 
@@ -298,13 +952,8 @@ void *Mem_GetOnePage(VirMemType virMemType, uintptr_t virAddrStart)
 void *Mem_GetUserPages(uint32_t pageNum)
 {
     Lock_Lock(&userMemPool.memLock);
+    /* 用户页在首次访问时才映射清0的页框，无需再清0 */
     void *virAddrStart = Mem_MallocPages(VIR_MEM_USER, pageNum);
-    if (virAddrStart == NULL) {
-        Lock_UnLock(&userMemPool.memLock);
-        return NULL;
-    }
-
-    memset(virAddrStart, 0, pageNum * PAGE_SIZE);
 
     Lock_UnLock(&userMemPool.memLock);
 
@@ -313,61 +962,173 @@ void *Mem_GetUserPages(uint32_t pageNum)
 
 /* 内核申请n个页空间 */
 void *Mem_GetKernelPages(uint32_t pageNum)
+{
+    return Mem_AllocKernelPages(pageNum, MEM_ALLOC_ZERO);
+}
+
+/* 内核按分配标志申请n个页空间 */
+void *Mem_AllocKernelPages(uint32_t pageNum, uint32_t flags)
 {
     Lock_Lock(&kernelMemPool.memLock);
+
+    /* 需要清0的单页优先从预清0页框池中取，PCB、页目录表、页表都走这条路径 */
+    if ((pageNum == 1) && (flags & MEM_ALLOC_ZERO)) {
+        void *pagePhyAddr = Mem_ZeroPoolPop(&kernelMemPool);
+        if (pagePhyAddr != NULL) {
+            void *virAddr = Mem_P2V((uintptr_t)pagePhyAddr);
+            if (virAddr == NULL) {
+                /* 迁移来的页框可能超出直接映射区 */
+                virAddr = Mem_GetVirAddr(VIR_MEM_KERNEL, 1);
+                if (virAddr == NULL) {
+                    Mem_PfreePfn(&kernelMemPool, PHY2PFN(pagePhyAddr));
+                    Lock_UnLock(&kernelMemPool.memLock);
+                    return NULL;
+                }
+                if (Mem_AddPageTable(virAddr, pagePhyAddr) == -1) {
+                    Mem_FreeVirAddr(VIR_MEM_KERNEL, virAddr, 1);
+                    Mem_PfreePfn(&kernelMemPool, PHY2PFN(pagePhyAddr));
+                    Lock_UnLock(&kernelMemPool.memLock);
+                    return NULL;
+                }
+            }
+            kernelMemPool.zeroHits++;
+            Lock_UnLock(&kernelMemPool.memLock);
+            return virAddr;
+        }
+        kernelMemPool.zeroMisses++;
+    }
+
     void *virAddrStart = Mem_MallocPages(VIR_MEM_KERNEL, pageNum);
     if (virAddrStart == NULL) {
         Lock_UnLock(&kernelMemPool.memLock);
         return NULL;
     }
 
-    memset(virAddrStart, 0, pageNum * PAGE_SIZE);
+    if (flags & MEM_ALLOC_ZERO) {
+        memset(virAddrStart, 0, pageNum * PAGE_SIZE);
+    }
 
     Lock_UnLock(&kernelMemPool.memLock);
     return virAddrStart;
 }
 
+/* 页框预清0线程：空闲时从伙伴系统中取出页框清0，放入预清0页框池 */
+static void Mem_ZeroThread(void *args)
+{
+    (void)args;
+
+    while (1) {
+        /* 优先补充预清0页框少的内存池 */
+        MemPool *memPool = (kernelMemPool.zeroCnt <= userMemPool.zeroCnt) ? &kernelMemPool : &userMemPool;
+
+        IntrStatus oldStatus = Idt_IntrDisable();
+        if (memPool->zeroCnt >= MEM_ZERO_POOL_MAX) {
+            /* 两个池都已满，等待分配者取走页框后唤醒 */
+            Thread_Block(TASK_BLOCKED);
+            Idt_SetIntrStatus(oldStatus);
+            continue;
+        }
+        Idt_SetIntrStatus(oldStatus);
+
+        void *pagePhyAddr = NULL;
+        Lock_Lock(&memPool->memLock);
+        if (memPool->freePages > MEM_ZERO_RESERVE) {
+            pagePhyAddr = Mem_PallocOrder(memPool, 0);
+        }
+        Lock_UnLock(&memPool->memLock);
+
+        if (pagePhyAddr == NULL) {
+            /* 空闲页框不多，让出处理器 */
+            Thread_Yield();
+            continue;
+        }
+
+        /* 清0过程不持有内存池锁 */
+        void *virAddr = Mem_Kmap((uintptr_t)pagePhyAddr);
+        if (virAddr != NULL) {
+            memset(virAddr, 0, PAGE_SIZE);
+            Mem_Kunmap(virAddr);
+        }
+
+        Lock_Lock(&memPool->memLock);
+        if (virAddr != NULL) {
+            List_Append(&memPool->zeroList, &Mem_Phy2Page((uintptr_t)pagePhyAddr)->freeTag);
+            memPool->zeroCnt++;
+        } else {
+            Mem_PfreePfn(memPool, PHY2PFN(pagePhyAddr));
+        }
+        Lock_UnLock(&memPool->memLock);
+    }
+}
+
+/* 启动页框预清0线程，需在任务模块初始化之后调用 */
+void Mem_ZeroInit(void)
+{
+    g_zeroTask = Thread_Create("page_zero", MEM_ZERO_PRIO, Mem_ZeroThread, NULL);
+    ASSERT(g_zeroTask != NULL);
+}
+
 /* 根据虚拟地址获取对应物理地址 */
 uintptr_t Mem_V2P(uintptr_t virAddr)
 {
+    /* 直接映射区为线性映射，无需查页表 */
+    if (Mem_InDirectMap(virAddr)) {
+        return virAddr - K_DIRECT_MAP_BASE;
+    }
+
+    /* 4M大页没有页表，物理地址直接由页目录项得到 */
+    uint32_t *pde = Mem_GetVirAddrPdePtr(virAddr);
+    if (*pde & PG_PS) {
+        return (uintptr_t)((*pde & 0xffc00000) + (virAddr & 0x003fffff));
+    }
+
     /* 获取virAddr对应的页表物理地址 */
     uint32_t *pte = Mem_GetVirAddrPtePtr(virAddr);
     return (uintptr_t)((*pte & 0xfffff000) + (virAddr & 0x00000fff));
 }
 
-/* 初始化内核内存块描述符数组 */
-void Mem_BlockDescInit(MemBlockDesc *memBlockDesc)
+/* 虚拟地址页是否已经映射了页框 */
+static inline bool Mem_IsMapped(uintptr_t virAddr)
 {
-    uint32_t blockSize = 16;
-    for (uint8_t i = 0; i < DESC_CNT; i++) {
-        /* 每个内存块大小 */
-        memBlockDesc[i].blockSize = blockSize;
-        memBlockDesc[i].blockPerArena = (PAGE_SIZE - sizeof(MemArena)) / blockSize;
-        List_Init(&memBlockDesc[i].freeList);
+    /* 页目录项不存在时不能访问页表项，否则会引发缺页 */
+    if (!(*Mem_GetVirAddrPdePtr(virAddr) & PG_P_1)) {
+        return false;
+    }
 
-        blockSize *= 2;
+    if (*Mem_GetVirAddrPdePtr(virAddr) & PG_PS) {
+        return true;
     }
-}
 
-/* 获取arena中的第n个内存块 */
-static inline MemBlock *Mem_Arena2Block(const MemArena *arena, uint32_t n)
-{
-    return (MemBlock *)((uintptr_t)arena + sizeof(MemArena) + n * arena->desc->blockSize);
+    return (*Mem_GetVirAddrPtePtr(virAddr) & PG_P_1) ? true : false;
 }
 
-/* 获取arena中的第n个内存块 */
-static inline MemArena *Mem_Block2Arena(const MemBlock *memBlock)
+/* 用户虚拟地址对应的页面已被换出时返回其页表项指针，否则返回NULL */
+static inline uint32_t *Mem_SwapPte(uintptr_t virAddr)
 {
-    return (MemArena *)((uintptr_t)memBlock & 0xfffff000);
+    uint32_t pde = *Mem_GetVirAddrPdePtr(virAddr);
+    if (!(pde & PG_P_1) || (pde & PG_PS)) {
+        return NULL;
+    }
+
+    uint32_t *pte = Mem_GetVirAddrPtePtr(virAddr);
+    if ((*pte & (PG_SWAP | PG_P_1)) != PG_SWAP) {
+        return NULL;
+    }
+
+    return pte;
 }
 
 /* 解除虚拟地址页和物理地址的映射关系 */
 static void inline Mem_PageTableRemove(uintptr_t virAddr)
 {
+    if (!(*Mem_GetVirAddrPdePtr(virAddr) & PG_P_1)) {
+        return;
+    }
+
     uint32_t *pte = Mem_GetVirAddrPtePtr(virAddr);
     /* 将P位置0，表示不可访问 */
     *pte &= ~PG_P_1;
-    __asm__ volatile ("invlpg %0" : : "m"(virAddr) : "memory");
+    __asm__ volatile ("invlpg %0" : : "m"(*(uint8_t *)virAddr) : "memory");
 
     return;
 }
@@ -376,21 +1137,21 @@ static void inline Mem_PageTableRemove(uintptr_t virAddr)
 void Mem_FreeVirAddr(VirMemType type, void *virAddr, uint32_t pageCnt)
 {
     uint32_t cnt = 0;
-    uint32_t bitIndex;
     if (type == VIR_MEM_KERNEL) {
-        bitIndex = ((uintptr_t)virAddr - kernelVirMemPool.virtualAddrStart) / PAGE_SIZE;
+        /* 直接映射区的地址不占用内核虚拟地址位图，映射也不能解除 */
+        if (Mem_InDirectMap((uintptr_t)virAddr)) {
+            return;
+        }
+        Kva_Free(&kernelVirMemPool, (uintptr_t)virAddr, pageCnt);
         while (cnt < pageCnt) {
-            // ASSERT(BitmapGet(&kernelVirMemPool.bitmap, bitIndex) == 1);
-            BitmapSet(&kernelVirMemPool.bitmap, bitIndex + cnt, 0);
             Mem_PageTableRemove((uintptr_t)virAddr + cnt * PAGE_SIZE);
             cnt++;
         }
     } else if (type == VIR_MEM_USER) {
+        /* 拆分区域时申请描述符失败，该段地址只是继续保持预留，页框照常释放 */
         Task *currTask = Thread_GetRunningTask();
-        bitIndex = ((uintptr_t)virAddr - currTask->progVaddrPool.virtualAddrStart) / PAGE_SIZE;
+        Vma_Remove(&currTask->vmaSpace, (uintptr_t)virAddr, pageCnt * PAGE_SIZE);
         while (cnt < pageCnt) {
-            // ASSERT(BitmapGet(&currTask->progVaddrPool.bitmap, bitIndex) == 1);
-            BitmapSet(&currTask->progVaddrPool.bitmap, bitIndex + cnt, 0);
             Mem_PageTableRemove((uintptr_t)virAddr + cnt * PAGE_SIZE);
             cnt++;
         }
@@ -402,32 +1163,70 @@ void Mem_FreeVirAddr(VirMemType type, void *virAddr, uint32_t pageCnt)
 /* 将物理页回收 */
 void Mem_FreePhyAddr(uintptr_t phyAddr)
 {
-    uint32_t bitIndex;
-    MemPool *memPool = NULL;
-    if (phyAddr >= userMemPool.poolSize) {
-        /* 释放用户物理内存池 */
-        memPool = &userMemPool;
-        bitIndex = (phyAddr - userMemPool.phyAddrStart) / PAGE_SIZE;
-    } else {
-        memPool = &kernelMemPool;
-        bitIndex = (phyAddr - kernelMemPool.phyAddrStart) / PAGE_SIZE;
+    /* 页框可能已经迁移，按页框描述符中的归属标记找到所在内存池 */
+    MemPage *page = Mem_Phy2Page(phyAddr);
+    MemPool *memPool = (page->flags & MEM_PAGE_USER) ? &userMemPool : &kernelMemPool;
+
+    /* 写时复制共享的页框，只有最后一个映射释放时才真正回收 */
+    if (page->shareCnt > 0) {
+        page->shareCnt--;
+        return;
     }
 
-    /* 对应的图位应该为1，只能释放已经分配的物理页 */
-    ASSERT(BitmapGet(&memPool->bitmap, bitIndex) == 1);
-    /* 将内存池对应位清0 */
-    BitmapSet(&memPool->bitmap, bitIndex, 0);
+    Mem_PfreePfn(memPool, PHY2PFN(phyAddr));
 
     return;
 }
 
+/* 获取虚拟地址类型对应的内存池锁 */
+void Mem_PoolLock(VirMemType type)
+{
+    Lock_Lock((type == VIR_MEM_KERNEL) ? &kernelMemPool.memLock : &userMemPool.memLock);
+}
+
+/* 释放虚拟地址类型对应的内存池锁 */
+void Mem_PoolUnLock(VirMemType type)
+{
+    Lock_UnLock((type == VIR_MEM_KERNEL) ? &kernelMemPool.memLock : &userMemPool.memLock);
+}
+
+/* 两个物理内存池的页框总数 */
+uint32_t Mem_TotalPages(void)
+{
+    return kernelMemPool.totalPages + userMemPool.totalPages;
+}
+
 /* 释放虚拟地址virAddr的n个页面 */
 void Mem_Free(VirMemType type, void *virAddr, uint32_t n)
 {
+    /* 直接映射区的页没有单独的页表项，也不占用内核虚拟地址位图，只需归还页框 */
+    if ((type == VIR_MEM_KERNEL) && Mem_InDirectMap((uintptr_t)virAddr)) {
+        uintptr_t phyAddr = Mem_V2P((uintptr_t)virAddr);
+        for (uint32_t i = 0; i < n; i++) {
+            Mem_FreePhyAddr(phyAddr + i * PAGE_SIZE);
+        }
+        return;
+    }
+
     for (uint32_t i = 0; i < n; i++) {
+        /* 按需映射的用户页可能从未被访问过 */
+        uintptr_t pageAddr = (uintptr_t)virAddr + i * PAGE_SIZE;
+        if (!Mem_IsMapped(pageAddr)) {
+            /* 已换出的页只需归还交换槽 */
+            uint32_t *pte = Mem_SwapPte(pageAddr);
+            if (pte != NULL) {
+                Swap_SlotFree(*pte >> 12);
+                *pte = 0;
+            }
+            continue;
+        }
+
         /* 获取虚拟地址对应的物理地址 */
-        uintptr_t phyAddr = Mem_V2P((uintptr_t)virAddr + i * PAGE_SIZE);
+        uintptr_t phyAddr = Mem_V2P(pageAddr);
         Mem_FreePhyAddr(phyAddr);
+        if (type == VIR_MEM_USER) {
+            Thread_GetRunningTask()->rssPages--;
+        }
     }
 
     /* 释放虚拟地址 */
@@ -436,110 +1235,611 @@ void Mem_Free(VirMemType type, void *virAddr, uint32_t n)
     return;
 }
 
-/* 在堆上申请size大小字节内存 */
-void *Mem_Malloc(uint32_t size)
+/* 释放内核的n个页空间 */
+void Mem_FreeKernelPages(void *virAddr, uint32_t pageNum)
 {
-    VirMemType virMemType; 
-    MemPool *memPool = NULL;
-    MemBlockDesc *memBlockDesc = NULL;
-    /* 获取当前正在执行的任务 */
-    Task *currTask = Thread_GetRunningTask();
-    if (currTask->pgDir == NULL) {
-        /* 内核线程申请内存 */
-        virMemType = VIR_MEM_KERNEL;
-        memPool = &kernelMemPool;
-        memBlockDesc = kernelBlockDesc;
-    } else {
-        /* 用户进程申请内存 */
-        virMemType = VIR_MEM_USER;
-        memPool = &userMemPool;
-        memBlockDesc = currTask->memblockDesc;
+    Lock_Lock(&kernelMemPool.memLock);
+    Mem_Free(VIR_MEM_KERNEL, virAddr, pageNum);
+    Lock_UnLock(&kernelMemPool.memLock);
+}
+
+/* 获取物理页phyAddr的内核虚拟地址，超出直接映射区时临时映射到内核堆，失败返回NULL */
+void *Mem_Kmap(uintptr_t phyAddr)
+{
+    void *virAddr = Mem_P2V(phyAddr & 0xfffff000);
+    if (virAddr != NULL) {
+        return virAddr;
     }
 
-    /* 判断是否有足够则空间 */
-    if (size >= memPool->poolSize) {
-        return NULL;
+    Lock_Lock(&kernelMemPool.memLock);
+    virAddr = Mem_GetVirAddr(VIR_MEM_KERNEL, 1);
+    if ((virAddr != NULL) && (Mem_AddPageTable(virAddr, (void *)(phyAddr & 0xfffff000)) == -1)) {
+        Mem_FreeVirAddr(VIR_MEM_KERNEL, virAddr, 1);
+        virAddr = NULL;
     }
+    Lock_UnLock(&kernelMemPool.memLock);
 
+    return virAddr;
+}
+
+/* 解除Mem_Kmap建立的临时映射，页框本身不释放 */
+void Mem_Kunmap(void *virAddr)
+{
+    if (Mem_InDirectMap((uintptr_t)virAddr)) {
+        return;
+    }
+
+    Lock_Lock(&kernelMemPool.memLock);
+    Mem_FreeVirAddr(VIR_MEM_KERNEL, virAddr, 1);
+    Lock_UnLock(&kernelMemPool.memLock);
+}
+
+/* 安装1页大小的vaddr，在fork场景使用 */
+void *Mem_GetPageWithoutOpBitmap(VirMemType type, uintptr_t vaddr)
+{
+    MemPool *memPool = type == VIR_MEM_KERNEL ? &kernelMemPool : &userMemPool;
     Lock_Lock(&memPool->memLock);
-    MemArena *arena = NULL;
-    /* 如果分配的是大内存（超过1024字节，则整个页框分配）*/
-    if (size > 1024) {
-        uint32_t pageCnt = DIV_ROUND_UP(size + sizeof(MemArena), PAGE_SIZE);
-        /* 申请n个物理页框，并返回对应的虚拟地址 */
-        arena = Mem_MallocPages(virMemType, pageCnt);
-        if (arena == NULL) {
-            Lock_UnLock(&memPool->memLock);
-            return NULL;
-        }
+    void *pagePhyAddr = Mem_Palloc(memPool);
+    if (pagePhyAddr == NULL) {
+        Lock_UnLock(&memPool->memLock);
+        return NULL;
+    }
 
-        /* 超过1024字节的内存块没有描述符 */
-        arena->desc = NULL;
-        arena->cnt = pageCnt;
-        arena->large = true;
+    if (Mem_AddPageTable((void *)vaddr, pagePhyAddr) == -1) {
+        Mem_PfreePfn(memPool, PHY2PFN(pagePhyAddr));
         Lock_UnLock(&memPool->memLock);
-        /* 跳过开头的存放arena的空间，后面才是真正分配使用的内存 */
-        return (void *)(arena + 1);
-    } else {
-        /* 分配小内存，先找到对应描述符 */
-        uint8_t idx = 0;;
-        while ((idx < DESC_CNT) && (memBlockDesc[idx].blockSize < size)) {
-            idx++;
+        return NULL;
+    }
+    if (type == VIR_MEM_USER) {
+        Thread_GetRunningTask()->rssPages++;
+    }
+    Lock_UnLock(&memPool->memLock);
+
+    return (void *)vaddr;
+}
+
+/* 重新加载cr3，刷新整个TLB */
+static inline void Mem_FlushTlb(void)
+{
+    uint32_t cr3;
+    __asm__ volatile ("movl %%cr3, %0; movl %0, %%cr3" : "=r"(cr3) : : "memory");
+}
+
+/* 撤销已复制给子进程的前pdeCnt个页表，归还页表页框并释放对共享页框和交换槽的引用，调用者需持有用户内存池锁。
+ * 复制期间中断关闭，子进程页表与父进程对应页表的内容相同，按父进程页表逐项撤销 */
+static void Mem_CowUndo(uint32_t *childPgDir, uint32_t pdeCnt)
+{
+    Lock_Lock(&kernelMemPool.memLock);
+    for (uint32_t pdeIdx = 0; pdeIdx < pdeCnt; pdeIdx++) {
+        if (!(childPgDir[pdeIdx] & PG_P_1)) {
+            continue;
+        }
+
+        uint32_t *parentPt = (uint32_t *)(0xffc00000 + pdeIdx * PAGE_SIZE);
+        for (uint32_t pteIdx = 0; pteIdx < 1024; pteIdx++) {
+            uint32_t pte = parentPt[pteIdx];
+            if (pte & PG_P_1) {
+                Mem_FreePhyAddr(pte & 0xfffff000);
+            } else if (pte & PG_SWAP) {
+                Swap_SlotFree(pte >> 12);
+            }
+        }
+
+        Mem_FreePhyAddr(childPgDir[pdeIdx] & 0xfffff000);
+        childPgDir[pdeIdx] = 0;
+        g_pageTablePages--;
+    }
+    Lock_UnLock(&kernelMemPool.memLock);
+}
+
+/* 以写时复制方式将当前进程的用户空间共享给子进程页目录表 */
+int32_t Mem_CowCopyUserSpace(uint32_t *childPgDir)
+{
+    uint32_t *parentPde = (uint32_t *)0xfffff000;
+
+    /* fork期间中断关闭，提前确认物理内存能为子进程提供全部页表，内核内存池不足时从用户内存池迁入 */
+    uint32_t ptCnt = 0;
+    for (uint32_t pdeIdx = 0; pdeIdx < USER_PDE_CNT; pdeIdx++) {
+        if (parentPde[pdeIdx] & PG_P_1) {
+            ptCnt++;
+        }
+    }
+
+    if (kernelMemPool.freePages + userMemPool.freePages < ptCnt) {
+        return -1;
+    }
+
+    Lock_Lock(&userMemPool.memLock);
+    for (uint32_t pdeIdx = 0; pdeIdx < USER_PDE_CNT; pdeIdx++) {
+        if (!(parentPde[pdeIdx] & PG_P_1)) {
+            continue;
         }
 
-        ASSERT(idx < DESC_CNT);
+        /* 预检查只统计了空闲页框，内核虚拟地址或页框迁移仍可能失败，撤销已复制的页表 */
+        uint32_t *childPt = Mem_GetKernelPages(1);
+        if (childPt == NULL) {
+            Mem_CowUndo(childPgDir, pdeIdx);
+            Lock_UnLock(&userMemPool.memLock);
+            /* 父进程的页表项已被改为只读，写时发现没有共享者会直接恢复可写 */
+            Mem_FlushTlb();
+            return -1;
+        }
 
-        /* 先判断对应的描述符数组中是否还有空闲块 */
-        if (List_IsEmpty(&memBlockDesc[idx].freeList)) {
-            /* 创建可用的内存空间 */
-            arena = Mem_MallocPages(virMemType, 1);
-            if (arena == NULL) {
-                Lock_UnLock(&memPool->memLock);
-                return NULL;
+        /* 父子进程共享页框，可写的页都改为只读并打上写时复制标志 */
+        uint32_t *parentPt = (uint32_t *)(0xffc00000 + pdeIdx * PAGE_SIZE);
+        for (uint32_t pteIdx = 0; pteIdx < 1024; pteIdx++) {
+            uint32_t pte = parentPt[pteIdx];
+            if (!(pte & PG_P_1)) {
+                /* 已换出的页面，父子进程共享交换槽，各自换入时得到独立的页框 */
+                if (pte & PG_SWAP) {
+                    Swap_SlotDup(pte >> 12);
+                    childPt[pteIdx] = pte;
+                }
+                continue;
             }
 
-            /* 将新创建的内存块划分成多个小块 */
-            arena->desc = &memBlockDesc[idx];
-            arena->cnt = memBlockDesc[idx].blockPerArena;
-            arena->large = false;
-
-            /* 关中断，将内存块描述符添加到freelist中 */
-            IntrStatus status = Idt_IntrDisable();
-            
-            for (uint8_t i = 0; i < arena->cnt; i++) {
-                MemBlock *memBlock = Mem_Arena2Block(arena, i);
-                ASSERT(List_Find(&arena->desc->freeList, &memBlock->freeNode) == false);
-                List_Append(&arena->desc->freeList, &memBlock->freeNode);
+            if (pte & PG_RW_W) {
+                pte = (pte & ~PG_RW_W) | PG_COW;
+                parentPt[pteIdx] = pte;
             }
 
-            Idt_SetIntrStatus(status);
+            Mem_Phy2Page(pte & 0xfffff000)->shareCnt++;
+            childPt[pteIdx] = pte;
         }
 
-        /* 取空闲列表头节点，分配使用 */
-        MemBlock *memBlock = (MemBlock *)List_Pop(&memBlockDesc[idx].freeList);
-        /* 所在的arena块空闲数量减1 */
-        arena = Mem_Block2Arena(memBlock);
-        arena->cnt--;
-        Lock_UnLock(&memPool->memLock);
-        return (void *)memBlock;
+        childPgDir[pdeIdx] = Mem_V2P((uintptr_t)childPt) | PG_US_U | PG_RW_W | PG_P_1;
+        g_pageTablePages++;
+
+        /* 只归还内核虚拟地址，页框留给子进程作为页表，直接映射区的页无需归还 */
+        Lock_Lock(&kernelMemPool.memLock);
+        Mem_FreeVirAddr(VIR_MEM_KERNEL, childPt, 1);
+        Lock_UnLock(&kernelMemPool.memLock);
     }
+    Lock_UnLock(&userMemPool.memLock);
+
+    /* 父进程的页表项已被改为只读，需要刷新TLB */
+    Mem_FlushTlb();
+
+    return 0;
 }
 
-/* 安装1页大小的vaddr，在fork场景使用 */
-void *Mem_GetPageWithoutOpBitmap(VirMemType type, uintptr_t vaddr)
+/* 释放当前进程用户空间的全部页框和页表 */
+void Mem_ReleaseUserSpace(void)
 {
-    MemPool *memPool = type == VIR_MEM_KERNEL ? &kernelMemPool : &userMemPool;
-    Lock_Lock(&memPool->memLock);
-    void *pagePhyAddr = Mem_Palloc(memPool);
+    uint32_t *pde = (uint32_t *)0xfffff000;
+
+    Lock_Lock(&userMemPool.memLock);
+    Lock_Lock(&kernelMemPool.memLock);
+    for (uint32_t pdeIdx = 0; pdeIdx < USER_PDE_CNT; pdeIdx++) {
+        if (!(pde[pdeIdx] & PG_P_1)) {
+            continue;
+        }
+
+        uint32_t *pt = (uint32_t *)(0xffc00000 + pdeIdx * PAGE_SIZE);
+        for (uint32_t pteIdx = 0; pteIdx < 1024; pteIdx++) {
+            if (pt[pteIdx] & PG_P_1) {
+                Mem_FreePhyAddr(pt[pteIdx] & 0xfffff000);
+            } else if (pt[pteIdx] & PG_SWAP) {
+                Swap_SlotFree(pt[pteIdx] >> 12);
+            }
+            pt[pteIdx] = 0;
+        }
+
+        /* 用户进程的页表存放在内核物理内存池中 */
+        Mem_FreePhyAddr(pde[pdeIdx] & 0xfffff000);
+        pde[pdeIdx] = 0;
+        g_pageTablePages--;
+    }
+    Thread_GetRunningTask()->rssPages = 0;
+    Lock_UnLock(&kernelMemPool.memLock);
+    Lock_UnLock(&userMemPool.memLock);
+
+    Mem_FlushTlb();
+}
+
+/* 正在写盘的交换槽，写盘期间不持有用户内存池的锁，页面所属进程在此期间缺页时需等待写盘完成 */
+static uint32_t g_swapIoSlots[MEM_SWAP_IO_MAX];
+static uint32_t g_swapIoCnt = 0;
+
+/* 交换槽是否正在写盘，调用者持有用户内存池的锁 */
+static bool Mem_SwapIoBusy(uint32_t slot)
+{
+    for (uint32_t i = 0; i < g_swapIoCnt; i++) {
+        if (g_swapIoSlots[i] == slot) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* 登记开始写盘的交换槽，并持有一个引用，避免写盘期间页面被释放后交换槽被重新分配 */
+static void Mem_SwapIoBegin(uint32_t slot)
+{
+    ASSERT(g_swapIoCnt < MEM_SWAP_IO_MAX);
+    g_swapIoSlots[g_swapIoCnt++] = slot;
+    Swap_SlotDup(slot);
+}
+
+/* 写盘完成，注销交换槽并释放登记时持有的引用 */
+static void Mem_SwapIoEnd(uint32_t slot)
+{
+    for (uint32_t i = 0; i < g_swapIoCnt; i++) {
+        if (g_swapIoSlots[i] == slot) {
+            g_swapIoSlots[i] = g_swapIoSlots[--g_swapIoCnt];
+            break;
+        }
+    }
+    Swap_SlotFree(slot);
+}
+
+/* 换出task的一个页面：先解除映射再写入交换槽，最后归还页框。pte为通过临时映射访问的页表项。
+ * 页面解除映射后页框由本函数独占，写盘期间释放用户内存池的锁，其他任务的分配和缺页不必等待磁盘 */
+static bool Mem_SwapOutPage(Task *task, uintptr_t pageAddr, uint32_t *pte)
+{
+    if (g_swapIoCnt == MEM_SWAP_IO_MAX) {
+        return false;
+    }
+
+    int32_t slot = Swap_SlotAlloc();
+    if (slot == -1) {
+        return false;
+    }
+
+    uint32_t pteVal = *pte;
+    uintptr_t phyAddr = pteVal & 0xfffff000;
+    void *virAddr = Mem_Kmap(phyAddr);
+    if (virAddr == NULL) {
+        Swap_SlotFree(slot);
+        return false;
+    }
+
+    /* 其他进程的TLB在切换页表时刷新，只有当前进程需要立即失效 */
+    *pte = ((uint32_t)slot << 12) | PG_SWAP;
+    if (task == Thread_GetRunningTask()) {
+        __asm__ volatile ("invlpg %0" : : "m"(*(uint8_t *)pageAddr) : "memory");
+    }
+    task->rssPages--;
+
+    /* 释放锁之后task可能退出，不能再访问task和pte */
+    Mem_SwapIoBegin(slot);
+    Lock_UnLock(&userMemPool.memLock);
+    Swap_WritePage(slot, virAddr);
+    Lock_Lock(&userMemPool.memLock);
+    Mem_SwapIoEnd(slot);
+
+    Mem_Kunmap(virAddr);
+    Mem_FreePhyAddr(phyAddr);
+
+    return true;
+}
+
+/* 时钟算法：从task的扫描指针开始检查其用户页表项，访问位为1的清0后跳过，
+ * 换出第一个访问位为0的独占页面。task可以不是当前进程，页表通过临时映射访问，调用者持有用户内存池的锁
+ */
+static bool Mem_SwapScan(Task *task)
+{
+    uintptr_t addr = task->swapHand & 0xfffff000;
+    uint32_t *pt = NULL;
+    uint32_t ptPdeIdx = 0;
+    bool ret = false;
+    /* 最多扫描两圈，第一圈清除的访问位在第二圈仍为0即可换出 */
+    uint32_t budget = 2 * USER_PDE_CNT * 1024;
+    while (budget > 0) {
+        if (PDE_INDEX(addr) >= USER_PDE_CNT) {
+            addr = 0;
+        }
+
+        uint32_t pdeVal = task->pgDir[PDE_INDEX(addr)];
+        if ((pdeVal & PG_P_1) && !(pdeVal & PG_PS) && ((pt == NULL) || (ptPdeIdx != PDE_INDEX(addr)))) {
+            if (pt != NULL) {
+                Mem_Kunmap(pt);
+            }
+            pt = Mem_Kmap(pdeVal & 0xfffff000);
+            ptPdeIdx = PDE_INDEX(addr);
+        }
+        if (!(pdeVal & PG_P_1) || (pdeVal & PG_PS) || (pt == NULL)) {
+            /* 跳过整个页表 */
+            uint32_t skipCnt = 1024 - PTE_INDEX(addr);
+            addr += skipCnt * PAGE_SIZE;
+            budget = (budget > skipCnt) ? budget - skipCnt : 0;
+            continue;
+        }
+
+        uintptr_t pageAddr = addr;
+        uint32_t *pte = &pt[PTE_INDEX(pageAddr)];
+        addr += PAGE_SIZE;
+        budget--;
+
+        uint32_t pteVal = *pte;
+        if (!(pteVal & PG_P_1)) {
+            continue;
+        }
+
+        /* 只换出用户内存池中的独占页框，写时复制共享的页框有多个映射，不能换出 */
+        uint32_t pfn = PHY2PFN(pteVal);
+        if ((pfn < g_memPageBasePfn) || (pfn - g_memPageBasePfn >= g_memPageCnt)) {
+            continue;
+        }
+        MemPage *page = Mem_Pfn2Page(pfn);
+        if (!(page->flags & MEM_PAGE_USER) || (page->shareCnt > 0)) {
+            continue;
+        }
+
+        if (pteVal & PG_A) {
+            /* 最近被访问过，给第二次机会 */
+            *pte = pteVal & ~PG_A;
+            if (task == Thread_GetRunningTask()) {
+                __asm__ volatile ("invlpg %0" : : "m"(*(uint8_t *)pageAddr) : "memory");
+            }
+            continue;
+        }
+
+        task->swapHand = addr;
+        ret = Mem_SwapOutPage(task, pageAddr, pte);
+        break;
+    }
+
+    if (!ret) {
+        task->swapHand = addr;
+    }
+    if (pt != NULL) {
+        Mem_Kunmap(pt);
+    }
+
+    return ret;
+}
+
+/* 上次扫描的进程号，各进程轮流被扫描 */
+static pid_t g_swapVictimPid = 0;
+
+/* 取进程号在g_swapVictimPid之后的下一个用户进程，没有时从头开始，procCnt返回用户进程数 */
+static Task *Mem_SwapNextVictim(uint32_t *procCnt)
+{
+    Task *next = NULL;
+    Task *first = NULL;
+    *procCnt = 0;
+
+    /* 任务链表在关中断时修改 */
+    IntrStatus oldStatus = Idt_IntrDisable();
+    ListNode *node = threadAllList.head.next;
+    while (node != &threadAllList.tail) {
+        Task *task = ELEM2ENTRY(Task, threadListTag, node);
+        node = node->next;
+        if ((task->pgDir == NULL) || (task->taskStatus == TASK_DIED)) {
+            continue;
+        }
+
+        (*procCnt)++;
+        if ((first == NULL) || (task->pid < first->pid)) {
+            first = task;
+        }
+        if ((task->pid > g_swapVictimPid) && ((next == NULL) || (task->pid < next->pid))) {
+            next = task;
+        }
+    }
+    Idt_SetIntrStatus(oldStatus);
+
+    if (next == NULL) {
+        next = first;
+    }
+    if (next != NULL) {
+        g_swapVictimPid = next->pid;
+    }
+
+    return next;
+}
+
+/* 换出一个页面：轮流扫描所有用户进程的页表，而不只是发生缺页的进程，
+ * 占用大部分用户内存的进程同样会被换出。调用者持有用户内存池的锁，PCB和页目录表在该锁下才会被回收
+ */
+static bool Mem_SwapOut(void)
+{
+    if (!Swap_IsEnabled()) {
+        return false;
+    }
+
+    uint32_t procCnt = 0;
+    Task *task = Mem_SwapNextVictim(&procCnt);
+    for (uint32_t i = 0; (i < procCnt) && (task != NULL); i++) {
+        if (Mem_SwapScan(task)) {
+            return true;
+        }
+        task = Mem_SwapNextVictim(&procCnt);
+    }
+
+    return false;
+}
+
+/* 为用户进程分配一个页框，内存不足时换出页面后重试，调用者持有用户内存池的锁。
+ * 换出写盘期间会暂时释放锁，调用者需在返回后重新检查页表项 */
+static void *Mem_PallocUser(bool zero)
+{
+    for (uint32_t i = 0; i < MEM_SWAP_RETRY; i++) {
+        void *pagePhyAddr = zero ? Mem_PallocZero(&userMemPool) : Mem_Palloc(&userMemPool);
+        if (pagePhyAddr != NULL) {
+            return pagePhyAddr;
+        }
+
+        if (!Mem_SwapOut()) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/* 换入：从交换槽读回页面内容，页面恢复为该进程独占。
+ * 进程持有交换槽的引用，新页框尚未映射，读盘期间释放用户内存池的锁 */
+static bool Mem_SwapIn(uint32_t *pte)
+{
+    uint32_t pteVal = *pte;
+    uint32_t slot = pteVal >> 12;
+    void *pagePhyAddr = Mem_PallocUser(false);
     if (pagePhyAddr == NULL) {
-        Lock_UnLock(&memPool->memLock);
-        return NULL;
+        return false;
     }
 
-    Mem_AddPageTable((void *)vaddr, pagePhyAddr);
-    Lock_UnLock(&memPool->memLock);
+    void *virAddr = Mem_Kmap((uintptr_t)pagePhyAddr);
+    if (virAddr == NULL) {
+        Mem_PfreePfn(&userMemPool, PHY2PFN(pagePhyAddr));
+        return false;
+    }
+    Lock_UnLock(&userMemPool.memLock);
+    Swap_ReadPage(slot, virAddr);
+    Lock_Lock(&userMemPool.memLock);
+    Mem_Kunmap(virAddr);
 
-    return (void *)vaddr;
+    /* 释放锁期间页表项已被修改，放弃读入的页框，返回后重新触发缺页 */
+    if (*pte != pteVal) {
+        Mem_PfreePfn(&userMemPool, PHY2PFN(pagePhyAddr));
+        return true;
+    }
+
+    *pte = (uint32_t)pagePhyAddr | PG_US_U | PG_RW_W | PG_P_1;
+    Swap_SlotFree(slot);
+    Thread_GetRunningTask()->rssPages++;
+
+    return true;
+}
+
+/* 写时复制：为发生写异常的共享页分配独立的页框 */
+static bool Mem_CowBreak(uintptr_t faultAddr, uint32_t *pte)
+{
+    MemPage *page = Mem_Phy2Page(*pte & 0xfffff000);
+    if (page->shareCnt == 0) {
+        /* 其他映射都已释放，直接恢复写权限 */
+        *pte = (*pte | PG_RW_W) & ~PG_COW;
+        return true;
+    }
+
+    uint32_t pteVal = *pte;
+    void *newPhyAddr = Mem_PallocUser(false);
+    if (newPhyAddr == NULL) {
+        return false;
+    }
+
+    /* 分配时可能释放过锁，页面已被换出或不再共享时重新触发缺页 */
+    if ((*pte != pteVal) || (page->shareCnt == 0)) {
+        Mem_PfreePfn(&userMemPool, PHY2PFN(newPhyAddr));
+        return true;
+    }
+
+    /* 通过内核虚拟地址访问新页框，复制原页面内容 */
+    void *tmpVirAddr = Mem_Kmap((uintptr_t)newPhyAddr);
+    if (tmpVirAddr == NULL) {
+        Mem_PfreePfn(&userMemPool, PHY2PFN(newPhyAddr));
+        return false;
+    }
+    memcpy(tmpVirAddr, (void *)(faultAddr & 0xfffff000), PAGE_SIZE);
+    Mem_Kunmap(tmpVirAddr);
+
+    page->shareCnt--;
+    *pte = (uint32_t)newPhyAddr | ((*pte & 0x00000fff & ~PG_COW) | PG_RW_W);
+
+    return true;
+}
+
+/* 按需分页：为进程已预留但尚未映射的虚拟页映射一个清0的页框 */
+static bool Mem_DemandMap(uintptr_t faultAddr)
+{
+    Task *currTask = Thread_GetRunningTask();
+    if (currTask->pgDir == NULL) {
+        return false;
+    }
+
+    /* 只有在进程虚拟地址空间中已预留的地址才允许映射 */
+    if (Vma_Find(&currTask->vmaSpace, faultAddr) == NULL) {
+        return false;
+    }
+
+    void *pagePhyAddr = Mem_PallocUser(true);
+    if (pagePhyAddr == NULL) {
+        return false;
+    }
+
+    /* 内核内存池耗尽时无法分配页表，归还页框，缺页处理失败 */
+    if (Mem_AddPageTable((void *)(faultAddr & 0xfffff000), pagePhyAddr) == -1) {
+        Mem_PfreePfn(&userMemPool, PHY2PFN(pagePhyAddr));
+        return false;
+    }
+    currTask->rssPages++;
+
+    return true;
+}
+
+/* 缺页异常处理，能够处理时返回true */
+bool Mem_PageFault(uintptr_t faultAddr)
+{
+    if (PDE_INDEX(faultAddr) >= USER_PDE_CNT) {
+        return false;
+    }
+
+    bool ret = false;
+    Lock_Lock(&userMemPool.memLock);
+    if (!Mem_IsMapped(faultAddr)) {
+        /* 页面已被换出时换入，否则按需映射 */
+        uint32_t *pte = Mem_SwapPte(faultAddr);
+        if ((pte != NULL) && Mem_SwapIoBusy(*pte >> 12)) {
+            /* 页面正在写入交换槽，让出处理器，写盘完成后重新触发缺页 */
+            Lock_UnLock(&userMemPool.memLock);
+            Thread_Yield();
+            return true;
+        }
+        ret = (pte != NULL) ? Mem_SwapIn(pte) : Mem_DemandMap(faultAddr);
+    } else {
+        /* 页面存在但只读，只处理写时复制 */
+        uint32_t *pte = Mem_GetVirAddrPtePtr(faultAddr);
+        if (*pte & PG_COW) {
+            ret = Mem_CowBreak(faultAddr, pte);
+        }
+    }
+    Lock_UnLock(&userMemPool.memLock);
+
+    if (ret) {
+        __asm__ volatile ("invlpg %0" : : "m"(*(uint8_t *)faultAddr) : "memory");
+    }
+
+    return ret;
+}
+
+/* 用4M全局大页建立内核直接映射区，切换进程页表时内核的TLB项得以保留 */
+static void Mem_DirectMapInit(uint32_t allMemSize)
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if (!(edx & CPUID_EDX_PSE)) {
+        put_str("PSE is not supported, direct map disabled. \n");
+        return;
+    }
+
+    /* 必须先打开cr4.PSE，否则页目录项的PS位会被当作页表地址解析 */
+    uint32_t cr4;
+    __asm__ volatile ("movl %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_PSE;
+    if (edx & CPUID_EDX_PGE) {
+        cr4 |= CR4_PGE;
+        g_kernelPgGlobal = PG_G;
+    }
+    __asm__ volatile ("movl %0, %%cr4" : : "r"(cr4) : "memory");
+
+    uint32_t pdeCnt = DIV_ROUND_UP(allMemSize, LARGE_PAGE_SIZE);
+    if (pdeCnt > K_DIRECT_MAP_MAX / LARGE_PAGE_SIZE) {
+        pdeCnt = K_DIRECT_MAP_MAX / LARGE_PAGE_SIZE;
+    }
+
+    /* 替换loader建立的4K页表映射，低端1M的映射关系保持不变 */
+    uint32_t *pde = (uint32_t *)0xfffff000;
+    for (uint32_t i = 0; i < pdeCnt; i++) {
+        pde[PDE_INDEX(K_DIRECT_MAP_BASE) + i] = (i * LARGE_PAGE_SIZE) | g_kernelPgGlobal | PG_PS | PG_US_U | PG_RW_W | PG_P_1;
+    }
+    g_directMapSize = pdeCnt * LARGE_PAGE_SIZE;
+
+    Mem_FlushTlb();
+
+    put_str("direct map size: ");
+    put_int(g_directMapSize);
+    put_str("\n");
 }
 
 /* 内存管理模块初始化 */
@@ -547,71 +1847,166 @@ void Mem_Init(void)
 {
     put_str("Mem_Init start. \n");
 
-    /* loader已经算得总物理内存大小 */
-    uint32_t memTotalSize = (*(uint32_t *)MEM_TOTAL_SIZE_ADDR);
-    
+    /* 读取loader保存的完整内存布局 */
+    Mem_RangeInit();
+
+    /* 直接映射区覆盖到最高的可用物理地址 */
+    uint32_t maxPfn = g_memRanges[g_memRangeCnt - 1].endPfn;
+    uint32_t memTotalSize = (maxPfn > PHY2PFN(K_DIRECT_MAP_MAX)) ? K_DIRECT_MAP_MAX : PFN2PHY(maxPfn);
+
     put_str("memTotalSize: ");
     put_int(memTotalSize);
     put_str("\n");
 
-    Mem_PoolInit(memTotalSize);
+    Mem_DirectMapInit(memTotalSize);
+
+    Mem_PoolInit();
 
     /* 初始化内核内存块描述符数组 */
-    Mem_BlockDescInit(kernelBlockDesc);
+    Mem_HeapInit();
+
+    /* 初始化内核对象缓存 */
+    Slab_Init();
+
+    /* 初始化用户虚拟内存区域描述符缓存 */
+    Vma_Init();
+
+    /* 打开cr0的WP位，内核写只读的用户页同样触发缺页异常，写时复制才能生效 */
+    uint32_t cr0;
+    __asm__ volatile ("movl %%cr0, %0" : "=r"(cr0));
+    cr0 |= 0x00010000;
+    __asm__ volatile ("movl %0, %%cr0" : : "r"(cr0) : "memory");
 
     put_str("Mem_Init end. \n");
 }
 
 /* 系统调用相关函数实现 */
 
-void *sys_malloc(uint32_t size)
+/* 按页向上对齐 */
+static inline uintptr_t Mem_PageUp(uintptr_t addr)
 {
-    return Mem_Malloc(size);
+    return (addr + PAGE_SIZE - 1) & 0xfffff000;
 }
 
-void sys_free(void *addr)
+/* 将program break调整到addr，返回新的break，失败时返回原来的break */
+void *sys_brk(void *addr)
 {
-    ASSERT(addr != NULL);
-    if (addr == NULL) {
-        return;
+    Task *currTask = Thread_GetRunningTask();
+    uintptr_t newBrk = (uintptr_t)addr;
+    if ((currTask->pgDir == NULL) || (newBrk < currTask->brkStart) ||
+        (newBrk - currTask->brkStart > USER_BRK_MAX)) {
+        return (void *)currTask->brk;
     }
 
-    VirMemType type;
-    MemPool *memPool = NULL;
-    /* 通过判断是线程还是进程，获取到虚拟地址的类型 */
-    if (Thread_GetRunningTask()->pgDir == NULL) {
-        /* 内核线程 */
-        type = VIR_MEM_KERNEL;
-        memPool = &kernelMemPool;
-    } else {
-        type = VIR_MEM_USER;
-        memPool = &userMemPool;
+    /* brk不必按页对齐，区域按页预留，页框在首次访问时分配 */
+    uintptr_t oldEnd = Mem_PageUp(currTask->brk);
+    uintptr_t newEnd = Mem_PageUp(newBrk);
+
+    Lock_Lock(&userMemPool.memLock);
+    if (newEnd > oldEnd) {
+        /* 与其他区域重叠时扩展失败 */
+        if (Vma_Insert(&currTask->vmaSpace, oldEnd, newEnd - oldEnd, VMA_BRK) == -1) {
+            Lock_UnLock(&userMemPool.memLock);
+            return (void *)currTask->brk;
+        }
+    } else if (newEnd < oldEnd) {
+        Mem_Free(VIR_MEM_USER, (void *)newEnd, (oldEnd - newEnd) / PAGE_SIZE);
     }
+    currTask->brk = newBrk;
+    Lock_UnLock(&userMemPool.memLock);
 
-    Lock_Lock(&memPool->memLock);
-    MemBlock *memBlock = (MemBlock *)addr;
-    MemArena *arena = Mem_Block2Arena(memBlock);
-    if (arena->large == true) {
-        /* 大于1024字节空间的内存块 */
-        Mem_Free(type, (void *)arena, arena->cnt);
+    return (void *)newBrk;
+}
+
+/* 建立长度为len的匿名映射，页面在首次访问时分配，失败返回MAP_FAILED */
+void *sys_mmap(void *addr, uint32_t len, int32_t flags)
+{
+    Task *currTask = Thread_GetRunningTask();
+    if ((currTask->pgDir == NULL) || (len == 0) || !(flags & MAP_ANONYMOUS)) {
+        return MAP_FAILED;
+    }
+
+    len = Mem_PageUp(len);
+    if (len == 0) {
+        return MAP_FAILED;
+    }
+
+    uintptr_t start = NULL;
+    Lock_Lock(&userMemPool.memLock);
+    if (flags & MAP_FIXED) {
+        /* 固定地址必须按页对齐，且不能覆盖已有区域 */
+        start = (uintptr_t)addr;
+        if (((start & 0x00000fff) != 0) || (start < USER_VADDR_START) ||
+            (start + len < start) || (start + len > USER_VADDR_STACK) ||
+            (Vma_Insert(&currTask->vmaSpace, start, len, VMA_MMAP) == -1)) {
+            start = NULL;
+        }
     } else {
-        /* 小于或等于1024字节内存块回收 */
-        List_Append(&arena->desc->freeList, &memBlock->freeNode);
-
-        /* 只有当整块arena空间都空闲才回收页框 */
-        arena->cnt++;
-        if (arena->cnt == arena->desc->blockPerArena) {
-            for (uint32_t blockIndex = 0; blockIndex < arena->desc->blockPerArena; blockIndex++) {
-                MemBlock *memBlock = Mem_Arena2Block(arena, blockIndex);
-                ASSERT(List_Find(&arena->desc->freeList, &memBlock->freeNode) == true);
-                List_Remove(&memBlock->freeNode);
-            }
+        /* 不指定地址时忽略addr，由区域链表首次适配 */
+        start = Vma_Alloc(&currTask->vmaSpace, len, VMA_MMAP);
+    }
+    Lock_UnLock(&userMemPool.memLock);
+
+    return (start != NULL) ? (void *)start : MAP_FAILED;
+}
+
+/* 解除[addr, addr + len)的映射，失败返回-1 */
+int32_t sys_munmap(void *addr, uint32_t len)
+{
+    Task *currTask = Thread_GetRunningTask();
+    uintptr_t start = (uintptr_t)addr;
+    if ((currTask->pgDir == NULL) || (len == 0) || ((start & 0x00000fff) != 0)) {
+        return -1;
+    }
 
-            Mem_Free(type, (void *)arena, 1);
+    len = Mem_PageUp(len);
+    if ((len == 0) || (start < USER_VADDR_START) || (start + len < start) || (start + len > USER_VADDR_STACK)) {
+        return -1;
+    }
+
+    /* 区域中未映射或已换出的页由Mem_Free分别处理 */
+    Lock_Lock(&userMemPool.memLock);
+    Mem_Free(VIR_MEM_USER, addr, len / PAGE_SIZE);
+    Lock_UnLock(&userMemPool.memLock);
+
+    return 0;
+}
+
+/* 获取内存统计信息，所有数据来自分配和释放时维护的计数器 */
+int32_t sys_meminfo(MemInfo *info)
+{
+    if (info == NULL) {
+        return -1;
+    }
+
+    /* 先在内核栈上汇总，关中断期间不会发生缺页 */
+    MemInfo tmp;
+    IntrStatus oldStatus = Idt_IntrDisable();
+
+    tmp.kernelTotalPages = kernelMemPool.totalPages;
+    tmp.kernelFreePages = kernelMemPool.freePages;
+    tmp.userTotalPages = userMemPool.totalPages;
+    tmp.userFreePages = userMemPool.freePages;
+    Mem_HeapStat(tmp.kernelHeap, tmp.procHeap);
+    tmp.pageTablePages = g_pageTablePages;
+
+    tmp.taskCnt = 0;
+    ListNode *node = threadAllList.head.next;
+    while (node != &threadAllList.tail) {
+        Task *task = ELEM2ENTRY(Task, threadListTag, node);
+        if (tmp.taskCnt < MEMINFO_TASK_MAX) {
+            MemTaskInfo *taskInfo = &tmp.tasks[tmp.taskCnt];
+            taskInfo->pid = task->pid;
+            memcpy(taskInfo->name, task->name, sizeof(taskInfo->name));
+            taskInfo->rssPages = task->rssPages;
         }
+        tmp.taskCnt++;
+        node = node->next;
     }
-    
-    Lock_UnLock(&memPool->memLock);
 
-    return;
+    Idt_SetIntrStatus(oldStatus);
+
+    memcpy(info, &tmp, sizeof(MemInfo));
+
+    return 0;
 }
@@ -20,12 +20,12 @@
 #define PG_RW_W 2     /* R/W属性位，读/写/执行 */
 #define PG_US_S 0     /* 设置访问权限，系统级 */
 #define PG_US_U 4     /* 设置访问权限，用户级 */
-
-/* 虚拟地址内存池 */
-typedef struct {
-    Bitmap bitmap;
-    uint32_t virtualAddrStart;
-} VirtualMemPool;
+#define PG_A    0x20  /* 访问位，处理器访问页面时置1 */
+#define PG_D    0x40  /* 脏位，处理器写页面时置1 */
+#define PG_PS   0x80  /* 页目录项映射4M大页 */
+#define PG_G    0x100 /* 全局页，切换cr3时不刷新TLB（需打开cr4.PGE） */
+#define PG_COW  0x200 /* 写时复制标志，使用页表项中留给软件的第9位 */
+#define PG_SWAP 0x400 /* P位为0时表示页面已被换出，高20位为交换槽号，使用留给软件的第10位 */
 
 /* 虚拟地址分配类型 */
 typedef enum {
@@ -38,11 +38,22 @@ typedef struct {
     ListNode freeNode;
 } MemBlock;
 
+/* 每个规格最多保留的全空arena数，超出后立即归还页框 */
+#define MEM_EMPTY_ARENA_MAX 2
+
 /* 内存块描述符 */
 typedef struct {
     uint32_t blockSize;
     uint32_t blockPerArena;
     List freeList;
+    /* 保留的全空arena，其内存块仍挂在freeList中 */
+    List emptyList;
+    uint32_t emptyCnt;
+    /* 该规格映射和释放arena页的次数，用于观察页抖动 */
+    uint32_t pageMapCnt;
+    uint32_t pageUnmapCnt;
+    /* freeList中的空闲块数 */
+    uint32_t freeBlockCnt;
 } MemBlockDesc;
 
 /* 内存仓库 */
@@ -50,30 +61,156 @@ typedef struct {
     MemBlockDesc *desc;
     uint32_t cnt;
     bool large;
+    /* 小内存块arena所属规格在描述符数组中的下标 */
+    uint8_t descIdx;
+    /* 全空时在描述符emptyList中的节点 */
+    ListNode emptyTag;
 } MemArena;
 
+/* 伙伴系统最大阶数，最大的空闲块为2^MEM_MAX_ORDER个页（4M） */
+#define MEM_MAX_ORDER 10
+
+/* 物理页框描述符 */
+typedef struct {
+    /* 空闲块首页在伙伴空闲链表中的节点 */
+    ListNode freeTag;
+    /* 空闲块阶数，只在空闲块首页中有效 */
+    uint8_t order;
+    /* 页框状态 */
+    uint8_t flags;
+    /* 写时复制时除首个映射外共享该页框的映射数，为0时页框被独占 */
+    uint16_t shareCnt;
+} MemPage;
+
 /* 内存块描述符个数 */
 #define DESC_CNT 7
 
+/* 每个弹匣最多缓存的空闲块数，以及和内存池之间批量补充/归还的块数 */
+#define MEM_MAG_SIZE  8
+#define MEM_MAG_BATCH (MEM_MAG_SIZE / 2)
+
+/* 任务私有的空闲块弹匣，每个大小规格一个，访问时无需持有内存池锁 */
+typedef struct {
+    uint32_t cnt;
+    void *blocks[MEM_MAG_SIZE];
+    /* 命中弹匣和需要访问内存池的次数 */
+    uint32_t hits;
+    uint32_t misses;
+} MemMagazine;
+
+/* 页分配标志 */
+#define MEM_ALLOC_ZERO 0x01    /* 返回清0的页，单页分配优先使用预清0页框池 */
+
+/* meminfo最多返回的任务数 */
+#define MEMINFO_TASK_MAX 16
+
+/* 堆中一个规格的使用情况 */
+typedef struct {
+    uint32_t blockSize;
+    uint32_t arenaCnt;
+    uint32_t freeBlocks;
+} MemHeapInfo;
+
+/* 任务的常驻页数 */
+typedef struct {
+    uint32_t pid;
+    char name[16];
+    uint32_t rssPages;
+} MemTaskInfo;
+
+/* meminfo系统调用返回的内存统计 */
+typedef struct {
+    uint32_t kernelTotalPages;
+    uint32_t kernelFreePages;
+    uint32_t userTotalPages;
+    uint32_t userFreePages;
+    /* 内核堆和调用进程的堆 */
+    MemHeapInfo kernelHeap[DESC_CNT];
+    MemHeapInfo procHeap[DESC_CNT];
+    /* 用户空间页表占用的页数 */
+    uint32_t pageTablePages;
+    /* 任务总数，超出MEMINFO_TASK_MAX的部分不返回明细 */
+    uint32_t taskCnt;
+    MemTaskInfo tasks[MEMINFO_TASK_MAX];
+} MemInfo;
+
+/* mmap标志，只支持私有的匿名映射 */
+#define MAP_PRIVATE   0x02
+#define MAP_FIXED     0x10     /* 必须映射在addr处 */
+#define MAP_ANONYMOUS 0x20
+/* mmap失败返回值 */
+#define MAP_FAILED    ((void *)-1)
+
 /* 内存管理模块初始化入口 */
 void Mem_Init(void);
 /* 申请一页空间，并映射到指定地址 */
 void *Mem_GetOnePage(VirMemType virMemType, uintptr_t virAddrStart);
 /* 内核申请n个页空间 */
 void *Mem_GetKernelPages(uint32_t pageNum);
+/* 内核按分配标志申请n个页空间 */
+void *Mem_AllocKernelPages(uint32_t pageNum, uint32_t flags);
+/* 启动页框预清0线程，需在任务模块初始化之后调用 */
+void Mem_ZeroInit(void);
+/* 释放内核的n个页空间 */
+void Mem_FreeKernelPages(void *virAddr, uint32_t pageNum);
 /* 根据虚拟地址获取对应物理地址 */
 uintptr_t Mem_V2P(uintptr_t virAddr);
+/* 物理地址转换为直接映射区中的虚拟地址，不在直接映射区内时返回NULL */
+void *Mem_P2V(uintptr_t phyAddr);
+/* 获取物理页phyAddr的内核虚拟地址，超出直接映射区时临时映射到内核堆，失败返回NULL */
+void *Mem_Kmap(uintptr_t phyAddr);
+/* 解除Mem_Kmap建立的临时映射，页框本身不释放 */
+void Mem_Kunmap(void *virAddr);
+/* 根据物理地址获取页框描述符 */
+MemPage *Mem_Phy2Page(uintptr_t phyAddr);
+/* 分配n个页空间，成功则返回虚拟地址，失败时返回NULL */
+void *Mem_MallocPages(VirMemType virMemType, uint32_t pageNum);
+/* 释放虚拟地址virAddr的n个页面 */
+void Mem_Free(VirMemType type, void *virAddr, uint32_t n);
+/* 获取和释放虚拟地址类型对应的内存池锁，锁可重入 */
+void Mem_PoolLock(VirMemType type);
+void Mem_PoolUnLock(VirMemType type);
+/* 两个物理内存池的页框总数 */
+uint32_t Mem_TotalPages(void);
 
+/* 内核堆初始化 */
+void Mem_HeapInit(void);
 /* 初始化内核内存块描述符数组 */
 void Mem_BlockDescInit(MemBlockDesc *memBlockDesc);
 /* 在堆上申请size大小字节内存 */
 void *Mem_Malloc(uint32_t size);
+/* 初始化任务的弹匣数组 */
+void Mem_MagazineInit(MemMagazine *magazines);
+/* 将当前任务弹匣中缓存的内存块全部归还内存池，任务退出前调用 */
+void Mem_MagazineDrain(void);
+/* 打印当前任务各规格弹匣的命中情况 */
+void Mem_MagazinePrint(void);
+/* 将堆中保留的全空arena归还物理内存池，返回释放的页数 */
+uint32_t Mem_Reclaim(VirMemType type);
+/* 打印内核堆各规格的页抖动统计 */
+void Mem_HeapPrint(void);
+/* 填写内核堆和当前任务堆各规格的统计 */
+void Mem_HeapStat(MemHeapInfo *kernelHeap, MemHeapInfo *procHeap);
 
 void *sys_malloc(uint32_t size);
 void sys_free(void *addr);
+/* 将program break调整到addr，返回新的break，失败时返回原来的break */
+void *sys_brk(void *addr);
+/* 建立长度为len的匿名映射，页面在首次访问时分配，失败返回MAP_FAILED */
+void *sys_mmap(void *addr, uint32_t len, int32_t flags);
+/* 解除[addr, addr + len)的映射，失败返回-1 */
+int32_t sys_munmap(void *addr, uint32_t len);
+/* 获取内存统计信息 */
+int32_t sys_meminfo(MemInfo *info);
 /* 安装1页大小的vaddr，在fork场景使用 */
 void *Mem_GetPageWithoutOpBitmap(VirMemType type, uintptr_t vaddr);
 /* 将n个虚拟地址页回收 */
 void Mem_FreeVirAddr(VirMemType type, void *virAddr, uint32_t pageCnt);
+/* 以写时复制方式将当前进程的用户空间共享给子进程页目录表 */
+int32_t Mem_CowCopyUserSpace(uint32_t *childPgDir);
+/* 释放当前进程用户空间的全部页框和页表 */
+void Mem_ReleaseUserSpace(void);
+/* 缺页异常处理，能够处理时返回true */
+bool Mem_PageFault(uintptr_t faultAddr);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,225 @@
+/*
+ *  kernel/memprof.c
+ *
+ *  (C) 2021  Jacky
+ */
+
+#include "memprof.h"
+#include "stdint.h"
+#include "lib/print.h"
+
+#ifdef MEM_PROFILE
+
+#include "kernel/interrupt.h"
+#include "kernel/thread.h"
+#include "kernel/device/timer.h"
+
+/* 存活内存块记录，按地址散列，用下标串成链表 */
+typedef struct {
+    void *addr;
+    uint16_t site;
+    int16_t next;
+} MemProfLive;
+
+static MemProfSite g_profSites[MEMPROF_SITE_MAX];
+static uint32_t g_profSiteCnt;
+
+static MemProfLive g_profLive[MEMPROF_LIVE_MAX];
+static int16_t g_profHash[MEMPROF_HASH_CNT];
+static int16_t g_profFreeLive;
+static bool g_profInited;
+
+/* 全局统计 */
+static uint32_t g_profLiveBytes;
+static uint32_t g_profPeakBytes;
+static uint32_t g_profAllocCnt;
+static uint32_t g_profFreeCnt;
+static uint32_t g_profFailCnt;
+/* 调用点或存活记录用完而未被跟踪的分配次数 */
+static uint32_t g_profUntracked;
+static uint32_t g_profStartMs;
+
+static inline uint32_t MemProf_Hash(const void *addr)
+{
+    return ((uintptr_t)addr >> 4) & (MEMPROF_HASH_CNT - 1);
+}
+
+/* 首次使用时初始化，统计表都在bss中，只需串起空闲记录 */
+static void MemProf_Init(void)
+{
+    for (uint32_t i = 0; i < MEMPROF_HASH_CNT; i++) {
+        g_profHash[i] = -1;
+    }
+    for (uint32_t i = 0; i < MEMPROF_LIVE_MAX; i++) {
+        g_profLive[i].next = (i + 1 < MEMPROF_LIVE_MAX) ? (int16_t)(i + 1) : -1;
+    }
+    g_profFreeLive = 0;
+    g_profStartMs = Timer_GetMs();
+    g_profInited = true;
+}
+
+/* 查找调用点，不存在时新建，表满返回-1 */
+static int32_t MemProf_FindSite(uintptr_t caller, uint32_t sizeClass)
+{
+    for (uint32_t i = 0; i < g_profSiteCnt; i++) {
+        if ((g_profSites[i].caller == caller) && (g_profSites[i].sizeClass == sizeClass)) {
+            return i;
+        }
+    }
+
+    if (g_profSiteCnt == MEMPROF_SITE_MAX) {
+        return -1;
+    }
+
+    MemProfSite *site = &g_profSites[g_profSiteCnt];
+    site->caller = caller;
+    site->sizeClass = sizeClass;
+
+    return g_profSiteCnt++;
+}
+
+/* 记录一次分配，addr为NULL时只计入失败次数 */
+void MemProf_Alloc(void *addr, uint32_t sizeClass, uintptr_t caller)
+{
+    /* 只统计内核线程的堆分配，用户进程的系统调用分配不计入 */
+    if (Thread_GetRunningTask()->pgDir != NULL) {
+        return;
+    }
+
+    IntrStatus oldStatus = Idt_IntrDisable();
+    if (!g_profInited) {
+        MemProf_Init();
+    }
+
+    if (addr == NULL) {
+        g_profFailCnt++;
+        Idt_SetIntrStatus(oldStatus);
+        return;
+    }
+
+    g_profAllocCnt++;
+    int32_t siteIdx = MemProf_FindSite(caller, sizeClass);
+    if ((siteIdx == -1) || (g_profFreeLive == -1)) {
+        g_profUntracked++;
+        Idt_SetIntrStatus(oldStatus);
+        return;
+    }
+
+    MemProfLive *live = &g_profLive[g_profFreeLive];
+    int16_t liveIdx = g_profFreeLive;
+    g_profFreeLive = live->next;
+    live->addr = addr;
+    live->site = (uint16_t)siteIdx;
+    live->next = g_profHash[MemProf_Hash(addr)];
+    g_profHash[MemProf_Hash(addr)] = liveIdx;
+
+    MemProfSite *site = &g_profSites[siteIdx];
+    site->allocCnt++;
+    site->liveBytes += sizeClass;
+    if (site->liveBytes > site->peakBytes) {
+        site->peakBytes = site->liveBytes;
+    }
+
+    g_profLiveBytes += sizeClass;
+    if (g_profLiveBytes > g_profPeakBytes) {
+        g_profPeakBytes = g_profLiveBytes;
+    }
+
+    Idt_SetIntrStatus(oldStatus);
+}
+
+/* 记录一次释放 */
+void MemProf_Free(void *addr)
+{
+    if ((Thread_GetRunningTask()->pgDir != NULL) || !g_profInited) {
+        return;
+    }
+
+    IntrStatus oldStatus = Idt_IntrDisable();
+    g_profFreeCnt++;
+
+    /* 未被跟踪的内存块找不到记录，直接忽略 */
+    int16_t *link = &g_profHash[MemProf_Hash(addr)];
+    while ((*link != -1) && (g_profLive[*link].addr != addr)) {
+        link = &g_profLive[*link].next;
+    }
+    if (*link != -1) {
+        int16_t liveIdx = *link;
+        MemProfLive *live = &g_profLive[liveIdx];
+        MemProfSite *site = &g_profSites[live->site];
+        site->freeCnt++;
+        site->liveBytes -= site->sizeClass;
+        g_profLiveBytes -= site->sizeClass;
+
+        *link = live->next;
+        live->next = g_profFreeLive;
+        g_profFreeLive = liveIdx;
+    }
+
+    Idt_SetIntrStatus(oldStatus);
+}
+
+/* 打印各调用点的统计，每行一个调用点，caller需对照kernel.map解析 */
+void MemProf_Dump(void)
+{
+    IntrStatus oldStatus = Idt_IntrDisable();
+
+    uint32_t seconds = (Timer_GetMs() - g_profStartMs) / 1000;
+    if (seconds == 0) {
+        seconds = 1;
+    }
+
+    put_str("memprof: live 0x");
+    put_int(g_profLiveBytes);
+    put_str(", peak 0x");
+    put_int(g_profPeakBytes);
+    put_str(", allocs 0x");
+    put_int(g_profAllocCnt);
+    put_str(" (0x");
+    put_int(g_profAllocCnt / seconds);
+    put_str("/s), frees 0x");
+    put_int(g_profFreeCnt);
+    put_str(" (0x");
+    put_int(g_profFreeCnt / seconds);
+    put_str("/s), failed 0x");
+    put_int(g_profFailCnt);
+    put_str(", untracked 0x");
+    put_int(g_profUntracked);
+    put_str("\n");
+
+    for (uint32_t i = 0; i < g_profSiteCnt; i++) {
+        MemProfSite *site = &g_profSites[i];
+        put_str("memprof site 0x");
+        put_int(site->caller);
+        put_str(" class 0x");
+        put_int(site->sizeClass);
+        put_str(" allocs 0x");
+        put_int(site->allocCnt);
+        put_str(" frees 0x");
+        put_int(site->freeCnt);
+        put_str(" live 0x");
+        put_int(site->liveBytes);
+        put_str(" peak 0x");
+        put_int(site->peakBytes);
+        put_str("\n");
+    }
+
+    Idt_SetIntrStatus(oldStatus);
+}
+
+#else
+
+void MemProf_Alloc(void *addr, uint32_t sizeClass, uintptr_t caller)
+{
+}
+
+void MemProf_Free(void *addr)
+{
+}
+
+void MemProf_Dump(void)
+{
+    put_str("memprof: build with -DMEM_PROFILE=ON to enable\n");
+}
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ *  kernel/memprof.h
+ *
+ *  (C) 2021  Jacky
+ */
+#ifndef MEMPROF_H
+#define MEMPROF_H
+
+#include "stdint.h"
+
+/* 内核堆分配统计，编译时定义MEM_PROFILE才生效（cmake -DMEM_PROFILE=ON） */
+
+/* 最多统计的调用点数，超出的分配计入未跟踪计数 */
+#define MEMPROF_SITE_MAX  64
+/* 最多同时跟踪的存活内存块数 */
+#define MEMPROF_LIVE_MAX  1024
+/* 存活内存块散列桶数 */
+#define MEMPROF_HASH_CNT  256
+
+/* 一个调用点（返回地址 + 规格）的统计 */
+typedef struct {
+    /* 调用sys_malloc的返回地址，可以用tools/memprof_sym.py对照kernel.map解析 */
+    uintptr_t caller;
+    /* 实际占用的规格大小，小块为内存块大小，大块为整页大小 */
+    uint32_t sizeClass;
+    uint32_t allocCnt;
+    uint32_t freeCnt;
+    uint32_t liveBytes;
+    uint32_t peakBytes;
+} MemProfSite;
+
+/* 记录一次分配，addr为NULL时只计入失败次数 */
+void MemProf_Alloc(void *addr, uint32_t sizeClass, uintptr_t caller);
+/* 记录一次释放 */
+void MemProf_Free(void *addr);
+/* 打印各调用点的统计 */
+void MemProf_Dump(void);
+
+#endif
@@ -12,6 +12,7 @@
 #include "kernel/panic.h"
 #include "kernel/interrupt.h"
 #include "kernel/tss.h"
+#include "fs/file.h"
 #include "lib/string.h"
 
 /* 进程初始化 */
@@ -42,7 +43,8 @@ void Process_Start(void *func)
     initStack->eflags = (EFLAGS_IOPL_0 | EFLAGS_MBS | EFLAGS_IF_1);
 
     initStack->eip = func;
-    initStack->esp = (void *)((uintptr_t)Mem_GetOnePage(VIR_MEM_USER, USER_VADDR_STACK - PAGE_SIZE) + PAGE_SIZE);
+    /* 用户栈区域已由Process_VmaInit作为VMA_STACK区域插入，栈页在首次访问时由缺页异常映射 */
+    initStack->esp = (void *)USER_VADDR_STACK;
     initStack->ss = SELECTOR_U_STACK;
 
     /* 从中断处返回，退到低特权级 */
@@ -71,18 +73,20 @@ uint32_t *Process_PageDir(void)
     return pageDirVAddr;
 }
 
-/* 创建用户进程虚拟地址位图 */
-void Process_VAddrBitmap(Task *task)
+/* 创建用户进程虚拟地址空间，失败返回-1 */
+int32_t Process_VmaInit(Task *task)
 {
-    /* 用户进程虚拟内存池起始地址 */
-    task->progVaddrPool.virtualAddrStart = USER_VADDR_START;
-
-    /* 计算bitmap最少需要多少页 */
-    uint32_t bitmapPgCnt = DIV_ROUND_UP((0xc00000000 - USER_VADDR_START) / PAGE_SIZE / 8, PAGE_SIZE);
-    task->progVaddrPool.bitmap.bitmap = Mem_GetKernelPages(bitmapPgCnt);
-    task->progVaddrPool.bitmap.bitmapLen = (0xc00000000 - USER_VADDR_START) / PAGE_SIZE / 8;
-    /* 初始化虚拟地址内存池 */
-    BitmapInit(&task->progVaddrPool.bitmap);
+    Vma_SpaceInit(&task->vmaSpace);
+
+    /* 预留brk堆首页给用户态分配器，brk初始为空 */
+    task->brkStart = USER_BRK_START + PAGE_SIZE;
+    task->brk = task->brkStart;
+    if (Vma_Insert(&task->vmaSpace, USER_BRK_START, PAGE_SIZE, VMA_BRK) == -1) {
+        return -1;
+    }
+
+    /* 预留USER_VADDR_STACK之下的用户栈区域，栈向下增长时按需映射 */
+    return Vma_Insert(&task->vmaSpace, USER_VADDR_STACK - USER_STACK_SIZE, USER_STACK_SIZE, VMA_STACK);
 }
 
 /* 激活线程或进程页表 */
@@ -97,7 +101,12 @@ void Process_Activate(Task *task)
         pageDirPhyAddr = Mem_V2P((uintptr_t)task->pgDir);       
     }
 
-    __asm__ volatile ("movl %0, %%cr3" : : "r"(pageDirPhyAddr) : "memory");
+    /* 页表未变化时（如内核线程之间切换）无需重新加载cr3，避免刷新TLB */
+    uint32_t cr3;
+    __asm__ volatile ("movl %%cr3, %0" : "=r"(cr3));
+    if (cr3 != pageDirPhyAddr) {
+        __asm__ volatile ("movl %0, %%cr3" : : "r"(pageDirPhyAddr) : "memory");
+    }
 
     if (task->pgDir != NULL) {
         TSS_UpdateEsp(task);
@@ -114,12 +123,18 @@ void Process_Create(void *fileName, char *name)
 
     /* 2. 创建进程的主线程，进程启动为执行Process_Start(fileName)，后续通过Thread_Schedule函数切换 */
     Task *task = Thread_Create(name, 31, Process_Start, fileName);
+    if (task == NULL) {
+        Idt_SetIntrStatus(status);
+        return;
+    }
 
     /* 3. 创建也目录表 */
     task->pgDir = Process_PageDir();
 
-    /* 4. 初始化虚拟内存池 */
-    Process_VAddrBitmap(task);
+    /* 4. 初始化虚拟地址空间 */
+    if (Process_VmaInit(task) == -1) {
+        PANIC("Process_VmaInit failed!");
+    }
 
     /* 5. 初始化进程私有的内存描述符数组 */
     Mem_BlockDescInit(task->memblockDesc);
@@ -128,4 +143,27 @@ void Process_Create(void *fileName, char *name)
     Idt_SetIntrStatus(status);
 
     return;
-}
\ No newline at end of file
+}
+
+/* 进程退出，记录退出码，释放用户空间、文件和VMA链表，PCB和页目录表由后续创建任务时回收 */
+void sys_exit(int32_t status)
+{
+    Task *currTask = Thread_GetRunningTask();
+    ASSERT(currTask->pgDir != NULL);
+    currTask->exitStatus = status;
+
+    /* 关闭进程打开的文件 */
+    for (int32_t fd = 3; fd < MAX_FILES_OPEN_PER_PROC; fd++) {
+        if (currTask->fdTable[fd] != -1) {
+            sys_close(fd);
+        }
+    }
+
+    /* 弹匣中的用户堆块随用户空间一起释放，清空弹匣避免Thread_Exit再访问已解除映射的块 */
+    Mem_MagazineInit(currTask->magazines);
+    Mem_ReleaseUserSpace();
+
+    Vma_SpaceRelease(&currTask->vmaSpace);
+
+    Thread_Exit();
+}
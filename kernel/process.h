@@ -14,6 +14,12 @@
 #define USER_VADDR_START 0x8048000
 /* 用户进程最大的栈地址 */
 #define USER_VADDR_STACK 0xc0000000
+/* 用户栈最大空间，栈页按需映射 */
+#define USER_STACK_SIZE  (8 * 1024 * 1024)
+/* brk堆起始地址，首页预留给用户态分配器存放状态，之后才是可由brk调整的部分 */
+#define USER_BRK_START   0x40000000
+/* brk堆最大空间 */
+#define USER_BRK_MAX     (256 * 1024 * 1024)
 
 /* 激活线程或进程页表 */
 void Process_Activate(Task *task);
@@ -21,5 +27,7 @@ void Process_Activate(Task *task);
 void Process_Create(void *fileName, char *name);
 /* 创建进程页目录表 */
 uint32_t *Process_PageDir(void);
+/* 进程退出 */
+void sys_exit(int32_t status);
 
 #endif
\ No newline at end of file
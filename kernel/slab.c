@@ -0,0 +1,257 @@
+/*
+ *  kernel/slab.c
+ *
+ *  (C) 2021  Jacky
+ */
+
+#include "slab.h"
+#include "stdint.h"
+#include "kernel/memory.h"
+#include "kernel/panic.h"
+#include "kernel/sync.h"
+#include "lib/print.h"
+#include "lib/string.h"
+
+/* 缓存描述符表，缓存创建后不会被销毁 */
+static SlabCache g_slabCaches[SLAB_CACHE_MAX];
+static uint32_t g_slabCacheCnt;
+
+/* 对象是否按整页管理 */
+static inline bool Slab_IsPageObj(const SlabCache *cache)
+{
+    return cache->objSize > PAGE_SIZE - sizeof(Slab);
+}
+
+/* 对象所在的slab，slab头部位于对象所在页的起始位置 */
+static inline Slab *Slab_Obj2Slab(const void *obj)
+{
+    return (Slab *)((uintptr_t)obj & 0xfffff000);
+}
+
+/* 从内核物理内存池中申请一页作为新的slab，并把全部对象串成空闲链表 */
+static Slab *Slab_Grow(SlabCache *cache)
+{
+    /* slab中的对象在分配时才清0，页本身无需清0 */
+    Slab *slab = Mem_AllocKernelPages(1, 0);
+    if (slab == NULL) {
+        return NULL;
+    }
+
+    slab->cache = cache;
+    slab->inUse = 0;
+    slab->freeObj = NULL;
+
+    /* 倒序入链，使得分配顺序和地址顺序一致 */
+    uintptr_t objStart = (uintptr_t)slab + sizeof(Slab);
+    uint32_t objIndex = cache->objPerSlab;
+    while (objIndex > 0) {
+        objIndex--;
+        void *obj = (void *)(objStart + objIndex * cache->objSize);
+        *(void **)obj = slab->freeObj;
+        slab->freeObj = obj;
+    }
+
+    cache->slabCnt++;
+
+    return slab;
+}
+
+/* 对象缓存模块初始化 */
+void Slab_Init(void)
+{
+    put_str("Slab_Init start. \n");
+
+    g_slabCacheCnt = 0;
+    memset(g_slabCaches, 0, sizeof(g_slabCaches));
+
+    put_str("Slab_Init end. \n");
+}
+
+/* 创建名为name、对象大小为objSize的缓存，objSize需不大于一页 */
+SlabCache *Slab_CacheCreate(const char *name, uint32_t objSize, SlabCtor ctor)
+{
+    ASSERT((objSize > 0) && (objSize <= PAGE_SIZE));
+    if (g_slabCacheCnt == SLAB_CACHE_MAX) {
+        return NULL;
+    }
+
+    SlabCache *cache = &g_slabCaches[g_slabCacheCnt++];
+    uint32_t nameLen = strlen(name);
+    if (nameLen >= SLAB_NAME_LEN) {
+        nameLen = SLAB_NAME_LEN - 1;
+    }
+    memcpy(cache->name, name, nameLen);
+    cache->name[nameLen] = '\0';
+
+    /* 空闲对象需要存放链接指针，按4字节对齐 */
+    cache->objSize = (objSize + 3) & ~3;
+    cache->ctor = ctor;
+    if (Slab_IsPageObj(cache)) {
+        cache->objSize = PAGE_SIZE;
+        cache->objPerSlab = 1;
+    } else {
+        cache->objPerSlab = (PAGE_SIZE - sizeof(Slab)) / cache->objSize;
+    }
+
+    List_Init(&cache->partialList);
+    List_Init(&cache->fullList);
+    List_Init(&cache->freeList);
+    cache->freePage = NULL;
+    cache->slabCnt = 0;
+    cache->freeSlabCnt = 0;
+    cache->objInUse = 0;
+    Lock_Init(&cache->lock);
+
+    return cache;
+}
+
+/* 分配一个整页对象，zeroed返回对象是否已经清0 */
+static void *Slab_AllocPage(SlabCache *cache, bool *zeroed)
+{
+    void *obj = cache->freePage;
+    if (obj != NULL) {
+        cache->freePage = *(void **)obj;
+        cache->freeSlabCnt--;
+        *zeroed = false;
+        return obj;
+    }
+
+    /* 新页从预清0页框池中取，无需再清0 */
+    obj = Mem_GetKernelPages(1);
+    if (obj != NULL) {
+        cache->slabCnt++;
+    }
+    *zeroed = true;
+
+    return obj;
+}
+
+/* 从缓存中分配一个对象，ctor为空时返回清0的对象 */
+void *Slab_Alloc(SlabCache *cache)
+{
+    ASSERT(cache != NULL);
+
+    Lock_Lock(&cache->lock);
+
+    void *obj = NULL;
+    bool zeroed = false;
+    if (Slab_IsPageObj(cache)) {
+        obj = Slab_AllocPage(cache, &zeroed);
+        if (obj == NULL) {
+            Lock_UnLock(&cache->lock);
+            return NULL;
+        }
+    } else {
+        Slab *slab = NULL;
+        if (!List_IsEmpty(&cache->partialList)) {
+            slab = ELEM2ENTRY(Slab, slabTag, cache->partialList.head.next);
+        } else if (!List_IsEmpty(&cache->freeList)) {
+            slab = ELEM2ENTRY(Slab, slabTag, List_Pop(&cache->freeList));
+            cache->freeSlabCnt--;
+            List_Push(&cache->partialList, &slab->slabTag);
+        } else {
+            slab = Slab_Grow(cache);
+            if (slab == NULL) {
+                Lock_UnLock(&cache->lock);
+                return NULL;
+            }
+            List_Push(&cache->partialList, &slab->slabTag);
+        }
+
+        obj = slab->freeObj;
+        slab->freeObj = *(void **)obj;
+        slab->inUse++;
+        if (slab->inUse == cache->objPerSlab) {
+            List_Remove(&slab->slabTag);
+            List_Push(&cache->fullList, &slab->slabTag);
+        }
+    }
+
+    cache->objInUse++;
+
+    Lock_UnLock(&cache->lock);
+
+    if (cache->ctor != NULL) {
+        cache->ctor(obj);
+    } else if (!zeroed) {
+        memset(obj, 0, cache->objSize);
+    }
+
+    return obj;
+}
+
+/* 将对象归还给缓存 */
+void Slab_Free(SlabCache *cache, void *obj)
+{
+    ASSERT((cache != NULL) && (obj != NULL));
+
+    /* 超出保留上限的slab，在释放锁之后归还给内核物理内存池 */
+    void *releasePage = NULL;
+
+    Lock_Lock(&cache->lock);
+
+    if (Slab_IsPageObj(cache)) {
+        ASSERT(((uintptr_t)obj & 0x00000fff) == 0);
+        if (cache->freeSlabCnt < SLAB_FREE_MAX) {
+            *(void **)obj = cache->freePage;
+            cache->freePage = obj;
+            cache->freeSlabCnt++;
+        } else {
+            releasePage = obj;
+        }
+    } else {
+        Slab *slab = Slab_Obj2Slab(obj);
+        ASSERT((slab->cache == cache) && (slab->inUse > 0));
+
+        if (slab->inUse == cache->objPerSlab) {
+            /* 满slab释放一个对象后变为部分分配 */
+            List_Remove(&slab->slabTag);
+            List_Push(&cache->partialList, &slab->slabTag);
+        }
+
+        *(void **)obj = slab->freeObj;
+        slab->freeObj = obj;
+        slab->inUse--;
+
+        if (slab->inUse == 0) {
+            List_Remove(&slab->slabTag);
+            if (cache->freeSlabCnt < SLAB_FREE_MAX) {
+                List_Push(&cache->freeList, &slab->slabTag);
+                cache->freeSlabCnt++;
+            } else {
+                releasePage = slab;
+            }
+        }
+    }
+
+    cache->objInUse--;
+    if (releasePage != NULL) {
+        cache->slabCnt--;
+    }
+
+    Lock_UnLock(&cache->lock);
+
+    if (releasePage != NULL) {
+        Mem_FreeKernelPages(releasePage, 1);
+    }
+
+    return;
+}
+
+/* 打印所有缓存的使用情况 */
+void Slab_Print(void)
+{
+    for (uint32_t i = 0; i < g_slabCacheCnt; i++) {
+        SlabCache *cache = &g_slabCaches[i];
+        put_str(cache->name);
+        put_str(": objSize ");
+        put_int(cache->objSize);
+        put_str(", inUse ");
+        put_int(cache->objInUse);
+        put_str(", slabs ");
+        put_int(cache->slabCnt);
+        put_str(", freeSlabs ");
+        put_int(cache->freeSlabCnt);
+        put_str("\n");
+    }
+}
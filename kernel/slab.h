@@ -0,0 +1,67 @@
+/*
+ *  kernel/slab.h
+ *
+ *  (C) 2021  Jacky
+ */
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "stdint.h"
+#include "kernel/sync.h"
+#include "lib/list.h"
+
+/* 系统支持的最大对象缓存数 */
+#define SLAB_CACHE_MAX      16
+/* 对象缓存名字最大长度 */
+#define SLAB_NAME_LEN       16
+/* 每个缓存最多保留的全空slab数，超出的部分归还内核物理内存池 */
+#define SLAB_FREE_MAX       2
+
+/* 对象构造函数，对象每次被分配出去之前调用 */
+typedef void (*SlabCtor)(void *obj);
+
+/* slab头部，存放在slab页的起始位置 */
+typedef struct {
+    struct _SlabCache *cache;
+    /* 在cache的partial/full/free链表中的节点 */
+    ListNode slabTag;
+    /* 已分配出去的对象数 */
+    uint32_t inUse;
+    /* 空闲对象单链表，链接指针存放在空闲对象的首4字节 */
+    void *freeObj;
+} Slab;
+
+/* 固定大小的对象缓存 */
+typedef struct _SlabCache {
+    char name[SLAB_NAME_LEN];
+    /* 对象大小，已按4字节对齐 */
+    uint32_t objSize;
+    /* 每个slab能容纳的对象数，整页对象为1 */
+    uint32_t objPerSlab;
+    SlabCtor ctor;
+    /* 部分分配、全部分配、全空的slab链表 */
+    List partialList;
+    List fullList;
+    List freeList;
+    /* 整页对象没有空间存放slab头部，空闲页直接用单链表串起来 */
+    void *freePage;
+    /* 当前slab总数和全空slab数 */
+    uint32_t slabCnt;
+    uint32_t freeSlabCnt;
+    /* 已分配出去的对象数 */
+    uint32_t objInUse;
+    Lock lock;
+} SlabCache;
+
+/* 对象缓存模块初始化 */
+void Slab_Init(void);
+/* 创建名为name、对象大小为objSize的缓存，objSize需不大于一页 */
+SlabCache *Slab_CacheCreate(const char *name, uint32_t objSize, SlabCtor ctor);
+/* 从缓存中分配一个对象，ctor为空时返回清0的对象 */
+void *Slab_Alloc(SlabCache *cache);
+/* 将对象归还给缓存 */
+void Slab_Free(SlabCache *cache, void *obj);
+/* 打印所有缓存的使用情况 */
+void Slab_Print(void);
+
+#endif
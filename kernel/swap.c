@@ -0,0 +1,159 @@
+/*
+ *  kernel/swap.c
+ *
+ *  (C) 2021  Jacky
+ */
+
+#include "swap.h"
+#include "stdint.h"
+#include "kernel/bitmap.h"
+#include "kernel/global.h"
+#include "kernel/memory.h"
+#include "kernel/panic.h"
+#include "kernel/sync.h"
+#include "kernel/device/ide.h"
+#include "lib/list.h"
+#include "lib/print.h"
+#include "lib/string.h"
+
+/* 交换分区，为NULL表示未启用交换 */
+static Partition *g_swapPart;
+/* 交换槽位图，1表示交换槽已被占用 */
+static Bitmap g_swapBitmap;
+/* 每个交换槽的引用计数，fork后父子进程共享同一个交换槽，子进程个数不受限，计数不能用8位 */
+static uint32_t *g_swapRefs;
+/* 交换槽总数和已使用数 */
+static uint32_t g_swapSlotCnt;
+static uint32_t g_swapUsedCnt;
+static Lock g_swapLock;
+
+/* 在分区队列中查找交换分区 */
+static void Swap_FindPart(ListNode *partNode, void *arg)
+{
+    const char *partName = (const char *)arg;
+    Partition *part = ELEM2ENTRY(Partition, partTag, partNode);
+    if (strcmp(part->name, partName) == 0) {
+        g_swapPart = part;
+    }
+}
+
+/* 交换模块初始化，找不到交换分区时不启用交换 */
+void Swap_Init(void)
+{
+    put_str("Swap_Init start. \n");
+
+    g_swapPart = NULL;
+    List_Traversal(&g_partitionList, Swap_FindPart, SWAP_PART_NAME);
+    if (g_swapPart == NULL) {
+        put_str("no swap partition, swap disabled. \n");
+        return;
+    }
+
+    g_swapSlotCnt = g_swapPart->secCnt / SWAP_SECS_PER_SLOT;
+    g_swapUsedCnt = 0;
+    Lock_Init(&g_swapLock);
+
+    /* 位图和引用计数数组一起申请，引用计数数组按4字节对齐 */
+    uint32_t bitmapLen = DIV_ROUND_UP(g_swapSlotCnt, 8);
+    uint32_t refsOff = DIV_ROUND_UP(bitmapLen, sizeof(uint32_t)) * sizeof(uint32_t);
+    uint32_t pageCnt = DIV_ROUND_UP(refsOff + g_swapSlotCnt * sizeof(uint32_t), PAGE_SIZE);
+    uint8_t *buf = Mem_GetKernelPages(pageCnt);
+    if ((g_swapSlotCnt == 0) || (buf == NULL)) {
+        g_swapPart = NULL;
+        put_str("swap disabled. \n");
+        return;
+    }
+
+    g_swapBitmap.bitmap = buf;
+    g_swapBitmap.bitmapLen = bitmapLen;
+    BitmapInit(&g_swapBitmap);
+    g_swapRefs = (uint32_t *)(buf + refsOff);
+
+    put_str("swap partition: ");
+    put_str(g_swapPart->name);
+    put_str(", slots: ");
+    put_int(g_swapSlotCnt);
+    put_str("\n");
+
+    put_str("Swap_Init end. \n");
+}
+
+/* 是否已启用交换 */
+bool Swap_IsEnabled(void)
+{
+    return g_swapPart != NULL;
+}
+
+/* 分配一个交换槽，失败返回-1 */
+int32_t Swap_SlotAlloc(void)
+{
+    if (g_swapPart == NULL) {
+        return -1;
+    }
+
+    Lock_Lock(&g_swapLock);
+    int32_t slot = BitmapScan(&g_swapBitmap, 1);
+    if ((slot == -1) || ((uint32_t)slot >= g_swapSlotCnt)) {
+        Lock_UnLock(&g_swapLock);
+        return -1;
+    }
+    BitmapSet(&g_swapBitmap, slot, 1);
+    g_swapRefs[slot] = 1;
+    g_swapUsedCnt++;
+    Lock_UnLock(&g_swapLock);
+
+    return slot;
+}
+
+/* 交换槽被fork出的子进程共享，增加引用计数 */
+void Swap_SlotDup(uint32_t slot)
+{
+    ASSERT((slot < g_swapSlotCnt) && (g_swapRefs[slot] > 0));
+
+    Lock_Lock(&g_swapLock);
+    g_swapRefs[slot]++;
+    Lock_UnLock(&g_swapLock);
+}
+
+/* 释放交换槽的一个引用，引用计数为0时归还交换槽 */
+void Swap_SlotFree(uint32_t slot)
+{
+    ASSERT((slot < g_swapSlotCnt) && (g_swapRefs[slot] > 0));
+
+    Lock_Lock(&g_swapLock);
+    g_swapRefs[slot]--;
+    if (g_swapRefs[slot] == 0) {
+        BitmapSet(&g_swapBitmap, slot, 0);
+        g_swapUsedCnt--;
+    }
+    Lock_UnLock(&g_swapLock);
+}
+
+/* 将一页数据写入交换槽 */
+void Swap_WritePage(uint32_t slot, void *buf)
+{
+    ASSERT(slot < g_swapSlotCnt);
+    Ide_Write(g_swapPart->disk, g_swapPart->startLBA + slot * SWAP_SECS_PER_SLOT, buf, SWAP_SECS_PER_SLOT);
+}
+
+/* 从交换槽读出一页数据 */
+void Swap_ReadPage(uint32_t slot, void *buf)
+{
+    ASSERT(slot < g_swapSlotCnt);
+    Ide_Read(g_swapPart->disk, g_swapPart->startLBA + slot * SWAP_SECS_PER_SLOT, buf, SWAP_SECS_PER_SLOT);
+}
+
+/* 打印交换分区使用情况 */
+void Swap_Print(void)
+{
+    if (g_swapPart == NULL) {
+        put_str("swap disabled\n");
+        return;
+    }
+
+    put_str("swap slots: ");
+    put_int(g_swapSlotCnt);
+    put_str(", used: ");
+    put_int(g_swapUsedCnt);
+    put_str("\n");
+}
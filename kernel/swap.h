@@ -0,0 +1,34 @@
+/*
+ *  kernel/swap.h
+ *
+ *  (C) 2021  Jacky
+ */
+#ifndef SWAP_H
+#define SWAP_H
+
+#include "stdint.h"
+
+/* 用作交换分区的裸分区，文件系统初始化时不会格式化该分区 */
+#define SWAP_PART_NAME "sdb5"
+
+/* 每个交换槽存放一页，占8个扇区 */
+#define SWAP_SECS_PER_SLOT 8
+
+/* 交换模块初始化，找不到交换分区时不启用交换 */
+void Swap_Init(void);
+/* 是否已启用交换 */
+bool Swap_IsEnabled(void);
+/* 分配一个交换槽，失败返回-1 */
+int32_t Swap_SlotAlloc(void);
+/* 交换槽被fork出的子进程共享，增加引用计数 */
+void Swap_SlotDup(uint32_t slot);
+/* 释放交换槽的一个引用，引用计数为0时归还交换槽 */
+void Swap_SlotFree(uint32_t slot);
+/* 将一页数据写入交换槽 */
+void Swap_WritePage(uint32_t slot, void *buf);
+/* 从交换槽读出一页数据 */
+void Swap_ReadPage(uint32_t slot, void *buf);
+/* 打印交换分区使用情况 */
+void Swap_Print(void);
+
+#endif
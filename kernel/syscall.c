@@ -10,6 +10,7 @@
 #include "kernel/console.h"
 #include "kernel/panic.h"
 #include "kernel/fork.h"
+#include "kernel/process.h"
 #include "fs/fs.h"
 #include "fs/file.h"
 #include "lib/string.h"
@@ -132,6 +133,59 @@ pid_t fork(void)
     return _syscall0(SYS_FORK);
 }
 
+void exit(int32_t status)
+{
+    _syscall1(SYS_EXIT, status);
+}
+
+/* 将program break设置为addr，成功返回0，失败返回-1 */
+int32_t brk(void *addr)
+{
+    void *newBrk = (void *)_syscall1(SYS_BRK, addr);
+    return (newBrk == addr) ? 0 : -1;
+}
+
+/* 将program break移动increment字节，成功返回原来的break，失败返回(void *)-1 */
+void *sbrk(int32_t increment)
+{
+    uint8_t *oldBrk = (uint8_t *)_syscall1(SYS_BRK, NULL);
+    if (increment == 0) {
+        return oldBrk;
+    }
+
+    if (brk(oldBrk + increment) == -1) {
+        return (void *)-1;
+    }
+
+    return oldBrk;
+}
+
+/* 只支持匿名映射，不需要文件描述符和偏移 */
+void *mmap(void *addr, uint32_t len, int32_t flags)
+{
+    return (void *)_syscall3(SYS_MMAP, addr, len, flags);
+}
+
+int32_t munmap(void *addr, uint32_t len)
+{
+    return _syscall2(SYS_MUNMAP, addr, len);
+}
+
+int32_t meminfo(MemInfo *info)
+{
+    return _syscall1(SYS_MEMINFO, info);
+}
+
+int32_t sched_setscheduler(int32_t policy, uint32_t priority)
+{
+    return _syscall2(SYS_SCHED_SETSCHEDULER, policy, priority);
+}
+
+int32_t cpustat(CpuStat *stat)
+{
+    return _syscall1(SYS_CPUSTAT, stat);
+}
+
 /* 系统调用模块初始化 */
 void Syscall_Init(void)
 {
@@ -142,6 +196,13 @@ void Syscall_Init(void)
     syscall_table[SYS_MALLOC] = sys_malloc;
     syscall_table[SYS_FREE] = sys_free;
     syscall_table[SYS_FORK] = sys_fork;
+    syscall_table[SYS_EXIT] = sys_exit;
+    syscall_table[SYS_BRK] = sys_brk;
+    syscall_table[SYS_MMAP] = sys_mmap;
+    syscall_table[SYS_MUNMAP] = sys_munmap;
+    syscall_table[SYS_MEMINFO] = sys_meminfo;
+    syscall_table[SYS_SCHED_SETSCHEDULER] = sys_sched_setscheduler;
+    syscall_table[SYS_CPUSTAT] = sys_cpustat;
     Console_PutStr("Syscall_Init end.\n"); 
 
     return;
@@ -23,6 +23,15 @@
     ret;                                                                              \
 })
 
+/* 两个参系统调用 */
+#define _syscall2(NUMBER, ARG1, ARG2) ({                                              \
+    int32_t ret;                                                                      \
+    __asm__ volatile ("int $0x80"                                                     \
+    : "=a" (ret)                                                                      \
+    : "a" (NUMBER), "b" (ARG1), "c" (ARG2): "memory");                                \
+    ret;                                                                              \
+})
+
 /* 三个参系统调用 */
 #define _syscall3(NUMBER, ARG1, ARG2, ARG3) ({                                        \
     int32_t ret;                                                                      \
@@ -39,6 +48,13 @@ typedef enum {
     SYS_MALLOC,
     SYS_FREE,
     SYS_FORK,
+    SYS_EXIT,
+    SYS_BRK,
+    SYS_MMAP,
+    SYS_MUNMAP,
+    SYS_MEMINFO,
+    SYS_SCHED_SETSCHEDULER,
+    SYS_CPUSTAT,
 
     SYS_BUTT
 } SYSCALL_NR;
@@ -50,6 +66,14 @@ int32_t write(int32_t fd, const void *buf, uint32_t count);
 void *malloc(uint32_t size);
 void free(void *ptr);
 pid_t fork(void);
+void exit(int32_t status);
+int32_t brk(void *addr);
+void *sbrk(int32_t increment);
+void *mmap(void *addr, uint32_t len, int32_t flags);
+int32_t munmap(void *addr, uint32_t len);
+int32_t meminfo(MemInfo *info);
+int32_t sched_setscheduler(int32_t policy, uint32_t priority);
+int32_t cpustat(CpuStat *stat);
 
 pid_t sys_getpid(void);
 
@@ -12,19 +12,43 @@
 #include "kernel/interrupt.h"
 #include "kernel/process.h"
 #include "kernel/sync.h"
+#include "kernel/slab.h"
+#include "kernel/device/timer.h"
 #include "lib/string.h"
 #include "lib/list.h"
 #include "lib/print.h"
 
-/* 就绪队列 */
-List threadReadyList;
+/* 多级就绪队列，每个优先级一个链表，位图中第i位表示第i级链表非空 */
+typedef struct {
+    uint32_t bitmap;
+    List queues[THREAD_PRIO_LEVELS];
+} ThreadPrioArray;
+
+/* 活动队列中的任务依次按优先级运行，时间片用完的任务进入过期队列，
+ * 活动队列为空时两者交换，低优先级任务每轮都能得到运行 */
+static ThreadPrioArray g_prioArrays[2];
+static ThreadPrioArray *g_activeArray;
+static ThreadPrioArray *g_expiredArray;
+
+/* 实时任务就绪队列，不区分活动和过期 */
+static ThreadPrioArray g_rtArray;
+
+/* 有更高优先级的实时任务被唤醒，在中断返回或开中断时抢占当前任务 */
+uint32_t thread_need_resched;
 
 /* 所有任务队列 */
 List threadAllList;
 
+/* 已退出等待回收的任务队列 */
+static List threadDiedList;
+
 /* 主线程PCB */
 Task *mainThreadTask;
 
+/* 空闲任务，不在任何就绪队列中，没有其他可运行任务时才被调度 */
+static Task *g_idleTask;
+#define THREAD_IDLE_PRIO 1
+
 void init(void);
 
 /* 切换到下一个任务 */
@@ -33,6 +57,9 @@ void Thread_SwitchTo(Task *currTask, Task *nextTask);
 /* 分配pid锁 */
 static Lock g_pidLock;
 
+/* PCB对象缓存，每个PCB占用一页 */
+static SlabCache *g_taskCache;
+
 /* 获取当前任务的PCB地址 */
 Task *Thread_GetRunningTask(void)
 {
@@ -78,15 +105,21 @@ static inline void Thread_TaskInit(Task *task, const char *name, uint32_t priori
     strcpy(task->name, name);
     task->priority = priority;
     task->ticks = priority;
+    task->policy = SCHED_NORMAL;
     task->elapsedTicks = 0;
     task->pgDir = NULL;
     /* 以根目录为默认工作路径 */
     task->cwdIndoe = 0;
     /* -1表示没有父进程 */
     task->parentPid = -1;
+    task->exitStatus = 0;
     task->stackMagic = 0x19AE1617;
     task->taskStatus = TASK_READY;
 
+    Mem_MagazineInit(task->magazines);
+    List_NodeInit(&task->generalTag);
+    List_NodeInit(&task->threadListTag);
+
     task->fdTable[0] = 0;
     task->fdTable[1] = 1;
     task->fdTable[2] = 2;
@@ -118,11 +151,154 @@ static inline void Thread_TaskInit(Task *task, const char *name, uint32_t priori
     taskStack->threadArgs = threadArgs;
 }
 
+/* 回收已退出任务的页目录表和PCB */
+static void Thread_Reap(void)
+{
+    if (List_IsEmpty(&threadDiedList)) {
+        return;
+    }
+
+    /* 换出时持有用户内存池的锁扫描其他进程的页目录表，回收页目录表和PCB前需等待扫描结束 */
+    Mem_PoolLock(VIR_MEM_USER);
+    while (!List_IsEmpty(&threadDiedList)) {
+        Task *task = ELEM2ENTRY(Task, threadListTag, List_Pop(&threadDiedList));
+        ASSERT(task->taskStatus == TASK_DIED);
+        if (task->pgDir != NULL) {
+            Mem_FreeKernelPages(task->pgDir, 1);
+        }
+        Slab_Free(g_taskCache, task);
+    }
+    Mem_PoolUnLock(VIR_MEM_USER);
+}
+
+/* 从PCB缓存中分配一个任务PCB */
+Task *Thread_AllocTask(void)
+{
+    /* 退出的任务不能在自己的栈上释放PCB，延迟到下次创建任务时回收 */
+    Thread_Reap();
+
+    return (Task *)Slab_Alloc(g_taskCache);
+}
+
+/* 将任务PCB归还PCB缓存 */
+void Thread_FreeTask(Task *task)
+{
+    Slab_Free(g_taskCache, task);
+}
+
+/* 任务优先级对应的队列下标，下标越小优先级越高，便于用bsf查找 */
+static inline uint32_t Thread_PrioLevel(const Task *task)
+{
+    uint32_t priority = (task->priority < THREAD_PRIO_LEVELS) ? task->priority : THREAD_PRIO_LEVELS - 1;
+    return THREAD_PRIO_LEVELS - 1 - priority;
+}
+
+/* 将任务加入优先级队列，atHead为true时插入同级队首，调用者需关中断 */
+static void Thread_Enqueue(ThreadPrioArray *array, Task *task, bool atHead)
+{
+    uint32_t level = Thread_PrioLevel(task);
+    ASSERT(List_Find(&array->queues[level], &task->generalTag) == false);
+    if (atHead) {
+        List_Push(&array->queues[level], &task->generalTag);
+    } else {
+        List_Append(&array->queues[level], &task->generalTag);
+    }
+    array->bitmap |= (1U << level);
+}
+
+/* 优先级队列中非空的最高一级，bitmap不能为0 */
+static inline uint32_t Thread_TopLevel(const ThreadPrioArray *array)
+{
+    uint32_t level;
+    __asm__ ("bsfl %1, %0" : "=r"(level) : "r"(array->bitmap));
+    return level;
+}
+
+/* 从非空的优先级队列中取出优先级最高的任务 */
+static Task *Thread_ArrayPop(ThreadPrioArray *array)
+{
+    uint32_t level = Thread_TopLevel(array);
+    List *queue = &array->queues[level];
+    Task *task = Thread_GetTaskPCB(List_Pop(queue));
+    if (List_IsEmpty(queue)) {
+        array->bitmap &= ~(1U << level);
+    }
+
+    return task;
+}
+
+/* 取出优先级最高的就绪任务，没有就绪任务时返回NULL，调用者需关中断 */
+static Task *Thread_Dequeue(void)
+{
+    if (g_rtArray.bitmap != 0) {
+        return Thread_ArrayPop(&g_rtArray);
+    }
+
+    if (g_activeArray->bitmap == 0) {
+        ThreadPrioArray *array = g_activeArray;
+        g_activeArray = g_expiredArray;
+        g_expiredArray = array;
+        if (g_activeArray->bitmap == 0) {
+            return NULL;
+        }
+    }
+
+    return Thread_ArrayPop(g_activeArray);
+}
+
+/* 是否有实时任务应当抢占task */
+static inline bool Thread_RtPending(const Task *task)
+{
+    if (g_rtArray.bitmap == 0) {
+        return false;
+    }
+
+    return (task->policy == SCHED_NORMAL) || (Thread_TopLevel(&g_rtArray) < Thread_PrioLevel(task));
+}
+
+/* 当前任务是否应当被抢占：空闲任务遇到任何就绪任务，其他任务遇到更高优先级的实时任务 */
+static inline bool Thread_ShouldPreempt(const Task *task)
+{
+    if (task == g_idleTask) {
+        return (g_rtArray.bitmap | g_activeArray->bitmap | g_expiredArray->bitmap) != 0;
+    }
+
+    return Thread_RtPending(task);
+}
+
+/* 当前任务是否需要周期时钟轮转时间片：空闲任务和FIFO任务不需要，其他任务只在还有就绪任务时需要 */
+bool Thread_NeedTick(void)
+{
+    Task *currTask = Thread_GetRunningTask();
+    if ((currTask == g_idleTask) || (currTask->policy == SCHED_FIFO)) {
+        return false;
+    }
+
+    return (g_rtArray.bitmap | g_activeArray->bitmap | g_expiredArray->bitmap) != 0;
+}
+
+/* 任务的时间片长度 */
+uint8_t Thread_TimeSlice(const Task *task)
+{
+    return (task->policy == SCHED_RR) ? THREAD_RR_TICKS : task->priority;
+}
+
+/* 将任务加入就绪队列 */
+void Thread_ReadyAppend(Task *task)
+{
+    IntrStatus status = Idt_IntrDisable();
+    Thread_Enqueue(g_activeArray, task, false);
+    Idt_SetIntrStatus(status);
+}
+
 /* 线程创建函数 */
 Task *Thread_Create(const char *name, uint32_t priority, ThreadFunc threadFunc, void *threadArgs)
 {
     /* 创建线程PCB空间，即1个页表 */
-    Task *task = Mem_GetKernelPages(1);
+    Task *task = Thread_AllocTask();
+    if (task == NULL) {
+        return NULL;
+    }
 
     Thread_TaskInit(task, name, priority, threadFunc, threadArgs);
 
@@ -130,12 +306,33 @@ Task *Thread_Create(const char *name, uint32_t priority, ThreadFunc threadFunc,
     ASSERT(List_Find(&threadAllList, &(task->threadListTag)) != true);
     List_Append(&threadAllList, &(task->threadListTag));
 
-    ASSERT(List_Find(&threadReadyList, &(task->generalTag)) != true);
-    List_Append(&threadReadyList, &(task->generalTag));
+    Thread_ReadyAppend(task);
 
     return task;
 }
 
+/* 空闲任务，开中断后停机，直到下一个中断到来 */
+static void Thread_Idle(void *args)
+{
+    (void)args;
+
+    while (1) {
+        __asm__ volatile ("sti; hlt" : : : "memory");
+    }
+}
+
+/* 创建空闲任务，空闲任务只加入全部队列，不进入就绪队列 */
+static void Thread_MakeIdleThread(void)
+{
+    g_idleTask = Thread_AllocTask();
+    if (g_idleTask == NULL) {
+        PANIC("Thread_MakeIdleThread failed!");
+    }
+
+    Thread_TaskInit(g_idleTask, "idle", THREAD_IDLE_PRIO, Thread_Idle, NULL);
+    List_Append(&threadAllList, &g_idleTask->threadListTag);
+}
+
 /* 创建kernel的main线程，当前main线程的栈指针为0xc009f000，所以其PCB地址为0xc009e000 */
 static void Thread_MakeMainThread(void)
 {
@@ -162,25 +359,25 @@ void Thread_Schedule(void)
 {
     /* 获取当前的任务 */
     Task *currTask = Thread_GetRunningTask();
+    thread_need_resched = 0;
     if (currTask->taskStatus == TASK_RUNNING) {
-        /* 时间片用完调度 */
-        ASSERT(List_Find(&threadReadyList, &(currTask->generalTag)) != true);
-        /* 重新将当前任务加入链表 */
-        List_Append(&threadReadyList, &(currTask->generalTag));
+        /* 时间片用完或主动让出，重新分配时间片，实时任务排到同级队尾，普通任务放入过期队列 */
         currTask->taskStatus = TASK_READY;
-        currTask->ticks = currTask->priority;
+        currTask->ticks = Thread_TimeSlice(currTask);
+        if (currTask != g_idleTask) {
+            Thread_Enqueue((currTask->policy != SCHED_NORMAL) ? &g_rtArray : g_expiredArray, currTask, false);
+        }
     }
 
-    /* 如果链表队列为空，表示当前只有一个main任务，直接返回 */
-    if (List_IsEmpty(&threadReadyList) == true) {
-        return;
+    /* 取出优先级最高的就绪任务，没有可运行的任务时运行空闲任务 */
+    Task *nextTask = Thread_Dequeue();
+    if (nextTask == NULL) {
+        nextTask = g_idleTask;
     }
-
-    /* 从链表中获取链表头节点，送上CPU运行 */
-    ListNode *nextNode = List_Pop(&threadReadyList);
-    /* 获取节点对应任务的PCB */
-    Task *nextTask = Thread_GetTaskPCB(nextNode);
     nextTask->taskStatus = TASK_RUNNING;
+    if (nextTask == currTask) {
+        return;
+    }
     
     /* 激活下个任务的页表 */
     Process_Activate(nextTask);
@@ -191,14 +388,30 @@ void Thread_Schedule(void)
     return;
 }
 
+/* 当前任务退出，不再返回 */
+void Thread_Exit(void)
+{
+    /* 弹匣只能由任务自己清空，否则其中的内核堆块永远无法归还 */
+    Mem_MagazineDrain();
+
+    Idt_IntrDisable();
+    Task *currTask = Thread_GetRunningTask();
+    ASSERT(currTask != mainThreadTask);
+
+    currTask->taskStatus = TASK_DIED;
+    List_Remove(&currTask->threadListTag);
+    List_Append(&threadDiedList, &currTask->threadListTag);
+
+    Thread_Schedule();
+
+    PANIC("Thread_Exit: died task is scheduled!");
+}
+
 /* 任务主动让出cpu使用权 */
 void Thread_Yield(void)
 {
-    Task *currTask = Thread_GetRunningTask();
     IntrStatus status = Idt_IntrDisable();
-    currTask->taskStatus = TASK_READY;
-    ASSERT(List_Find(&threadReadyList, &currTask->generalTag) == false);
-    List_Append(&threadReadyList, &currTask->generalTag);
+    /* 以运行状态进入调度，与时间片用完的处理相同，同优先级的任务都能先运行 */
     Thread_Schedule();
     Idt_SetIntrStatus(status);
 
@@ -223,31 +436,133 @@ void Thread_Block(TaskStatus status)
 void Thread_UnBlock(Task *task)
 {
     ASSERT(task != NULL);
-    IntrStatus oldStatus = Idt_IntrEnable();
+    IntrStatus oldStatus = Idt_IntrDisable();
     IntrStatus status = task->taskStatus;
     ASSERT((status == TASK_BLOCKED) || (status == TASK_WAITING) || (status == TASK_HANDING));
     if (task->taskStatus != TASK_READY) {
-        /* 将任务添加到待运行队列 */
-        ASSERT(List_Find(&threadReadyList, &task->generalTag) == false);
-        List_Push(&threadReadyList, &task->generalTag);
+        if (task->policy != SCHED_NORMAL) {
+            /* 实时任务排到同级队尾，优先级高于当前任务时请求抢占，
+             * 中断上下文中在中断返回时切换，否则在恢复开中断时切换 */
+            Thread_Enqueue(&g_rtArray, task, false);
+        } else {
+            /* 被唤醒的任务放到活动队列同级队首，尽快得到运行 */
+            Thread_Enqueue(g_activeArray, task, true);
+        }
         task->taskStatus = TASK_READY;
+        /* 处理器空闲时同样立即切换，不必等空闲任务的时间片用完 */
+        if (Thread_ShouldPreempt(Thread_GetRunningTask())) {
+            thread_need_resched = 1;
+        } else if (Thread_NeedTick()) {
+            /* 当前任务不再单独运行，动态时钟需在下一个tick产生中断以轮转时间片 */
+            Timer_RequestTick();
+        }
     }
     
     /* 解阻塞后，重新设置中断状态 */
     Idt_SetIntrStatus(oldStatus);
 }
 
+/* 有更高优先级的实时任务就绪时让出处理器，需在关中断时调用 */
+void Thread_Preempt(void)
+{
+    ASSERT(Idt_GetIntrStatus() == INTR_OFF);
+    thread_need_resched = 0;
+
+    Task *currTask = Thread_GetRunningTask();
+    if ((currTask->taskStatus != TASK_RUNNING) || !Thread_ShouldPreempt(currTask)) {
+        return;
+    }
+
+    /* 被抢占的任务保留剩余时间片，放回同级队首，空闲任务直接让出 */
+    if (currTask != g_idleTask) {
+        currTask->taskStatus = TASK_READY;
+        Thread_Enqueue((currTask->policy != SCHED_NORMAL) ? &g_rtArray : g_activeArray, currTask, true);
+    }
+    Thread_Schedule();
+}
+
+/* 获取处理器使用统计 */
+int32_t sys_cpustat(CpuStat *stat)
+{
+    if (stat == NULL) {
+        return -1;
+    }
+
+    /* 空闲任务运行期间的时钟中断都计入其elapsedTicks */
+    CpuStat tmp;
+    IntrStatus oldStatus = Idt_IntrDisable();
+    tmp.totalTicks = Timer_GetTicks();
+    tmp.idleTicks = g_idleTask->elapsedTicks;
+    Idt_SetIntrStatus(oldStatus);
+
+    memcpy(stat, &tmp, sizeof(CpuStat));
+
+    return 0;
+}
+
+/* 设置当前任务的调度策略和优先级，参数非法时返回-1 */
+int32_t sys_sched_setscheduler(int32_t policy, uint32_t priority)
+{
+    if ((policy != SCHED_NORMAL) && (policy != SCHED_FIFO) && (policy != SCHED_RR)) {
+        return -1;
+    }
+    /* 普通任务的优先级即时间片长度，不能为0 */
+    if ((priority >= THREAD_PRIO_LEVELS) || ((policy == SCHED_NORMAL) && (priority == 0))) {
+        return -1;
+    }
+
+    Task *currTask = Thread_GetRunningTask();
+    /* 时钟中断不轮转FIFO任务，用户进程成为实时任务后可以一直占用处理器，实时策略只开放给内核线程 */
+    if ((policy != SCHED_NORMAL) && (currTask->pgDir != NULL)) {
+        return -1;
+    }
+
+    IntrStatus oldStatus = Idt_IntrDisable();
+    currTask->policy = policy;
+    currTask->priority = priority;
+    currTask->ticks = Thread_TimeSlice(currTask);
+    /* 降低优先级后可能有实时任务应当先运行 */
+    if (Thread_RtPending(currTask)) {
+        thread_need_resched = 1;
+    }
+    Idt_SetIntrStatus(oldStatus);
+
+    return 0;
+}
+
 /* 任务初始化 */
 void Thread_Init(void)
 {
     put_str("Thread_Init start. \n");
     
     List_Init(&threadAllList);
-    List_Init(&threadReadyList);
+    List_Init(&threadDiedList);
+    for (uint32_t i = 0; i < 2; i++) {
+        g_prioArrays[i].bitmap = 0;
+        for (uint32_t level = 0; level < THREAD_PRIO_LEVELS; level++) {
+            List_Init(&g_prioArrays[i].queues[level]);
+        }
+    }
+    g_activeArray = &g_prioArrays[0];
+    g_expiredArray = &g_prioArrays[1];
+    g_rtArray.bitmap = 0;
+    for (uint32_t level = 0; level < THREAD_PRIO_LEVELS; level++) {
+        List_Init(&g_rtArray.queues[level]);
+    }
+    thread_need_resched = 0;
     
     /* 初始化pid锁 */
     Lock_Init(&g_pidLock);
 
+    /* PCB必须整页对齐，栈顶位于PCB所在页的末尾 */
+    g_taskCache = Slab_CacheCreate("task", PAGE_SIZE, NULL);
+    if (g_taskCache == NULL) {
+        PANIC("Slab_CacheCreate failed!");
+    }
+
+    /* 创建空闲任务 */
+    Thread_MakeIdleThread();
+
     /* 先创建第一个用户进程：init */
     Process_Create(init, "init");
 
@@ -8,16 +8,28 @@
 
 #include "stdint.h"
 #include "kernel/memory.h"
+#include "kernel/vma.h"
 #include "lib/list.h"
 
-/* 就绪队列 */
-extern List threadReadyList;
-
 /* 所有任务队列 */
 extern List threadAllList;
 
 #define MAX_FILES_OPEN_PER_PROC 8
 
+/* 就绪队列的优先级级数，priority越大优先级越高，超出的按最高一级处理 */
+#define THREAD_PRIO_LEVELS 32
+
+/* 调度策略，实时任务总是先于普通任务运行，priority为实时优先级 */
+#define SCHED_NORMAL 0    /* 普通任务，priority同时决定时间片长度 */
+#define SCHED_FIFO   1    /* 实时任务，一直运行到阻塞、让出或被更高优先级实时任务抢占 */
+#define SCHED_RR     2    /* 实时任务，同优先级之间按THREAD_RR_TICKS轮转 */
+
+/* SCHED_RR任务的时间片 */
+#define THREAD_RR_TICKS 10
+
+/* 有更高优先级的实时任务被唤醒，在中断返回或开中断时抢占当前任务 */
+extern uint32_t thread_need_resched;
+
 /* 进程或线程状态枚举 */
 typedef enum {
     TASK_RUNNING,
@@ -89,6 +101,8 @@ typedef struct {
     uint8_t priority;
     /* 任务每次在处理器执行的时间 */
     uint8_t ticks;
+    /* 调度策略 */
+    uint8_t policy;
     /* 此任务自上cpu运行的时间 */
     uint32_t elapsedTicks;
     /* 文件描述符数组 */
@@ -99,18 +113,42 @@ typedef struct {
     ListNode threadListTag;
     /* 页表指针 */
     uint32_t *pgDir;
-    /* 进程自己页表虚拟地址管理池 */
-    VirtualMemPool progVaddrPool;
+    /* 进程用户虚拟地址空间中已预留的区域 */
+    VmaSpace vmaSpace;
+    /* 换出页面时时钟算法的扫描指针 */
+    uintptr_t swapHand;
+    /* brk堆的起始地址和当前结束地址（program break） */
+    uintptr_t brkStart;
+    uintptr_t brk;
+    /* 已映射的用户页数，写时复制共享的页在每个进程中都计入 */
+    uint32_t rssPages;
     /* 用户进程的虚拟地址 */
     MemBlockDesc memblockDesc[DESC_CNT];
+    /* 小内存块弹匣，缓存本任务最近释放的内存块 */
+    MemMagazine magazines[DESC_CNT];
     /* 记录任务的工作目录inode编号 */
     uint32_t cwdIndoe;
     /* 父进程pid */
     pid_t parentPid;
+    /* 进程退出码，由sys_exit记录，供以后的wait取用 */
+    int32_t exitStatus;
     /* 任务魔数，用于判断边界 */
     uint32_t stackMagic;
 } Task;
 
+/* 处理器使用统计，单位为时钟中断次数 */
+typedef struct {
+    uint32_t totalTicks;
+    /* 空闲任务运行的时间 */
+    uint32_t idleTicks;
+} CpuStat;
+
+
+/* 从PCB缓存中分配一个任务PCB */
+Task *Thread_AllocTask(void);
+
+/* 将任务PCB归还PCB缓存 */
+void Thread_FreeTask(Task *task);
 
 /* 线程创建函数 */
 Task *Thread_Create(const char *name, uint32_t priority, ThreadFunc threadFunc, void *threadArgs);
@@ -121,9 +159,27 @@ Task *Thread_GetRunningTask(void);
 /* 通过任务链表节点获取任务的PCB地址 */
 Task *Thread_GetTaskPCB(const ListNode *listNode);
 
+/* 将任务加入就绪队列 */
+void Thread_ReadyAppend(Task *task);
+
 /* 任务调度 */
 void Thread_Schedule(void);
 
+/* 有更高优先级的实时任务就绪时让出处理器，需在关中断时调用 */
+void Thread_Preempt(void);
+
+/* 当前任务是否需要周期时钟轮转时间片，需在关中断时调用 */
+bool Thread_NeedTick(void);
+
+/* 任务的时间片长度 */
+uint8_t Thread_TimeSlice(const Task *task);
+
+/* 设置当前任务的调度策略和优先级，参数非法或用户进程申请实时策略时返回-1 */
+int32_t sys_sched_setscheduler(int32_t policy, uint32_t priority);
+
+/* 获取处理器使用统计 */
+int32_t sys_cpustat(CpuStat *stat);
+
 /* 当前进程阻塞 */
 void Thread_Block(TaskStatus status);
 
@@ -133,6 +189,9 @@ void Thread_UnBlock(Task *task);
 /* 任务主动让出cpu使用权 */
 void Thread_Yield(void);
 
+/* 当前任务退出，不再返回 */
+void Thread_Exit(void);
+
 /* 任务初始化 */
 void Thread_Init(void);
 
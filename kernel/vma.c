@@ -0,0 +1,224 @@
+/*
+ *  kernel/vma.c
+ *
+ *  (C) 2021  Jacky
+ */
+
+#include "vma.h"
+#include "stdint.h"
+#include "kernel/panic.h"
+#include "kernel/slab.h"
+#include "kernel/process.h"
+#include "lib/print.h"
+
+/* 区域描述符缓存 */
+static SlabCache *g_vmaCache;
+
+static inline Vma *Vma_Entry(const ListNode *node)
+{
+    return ELEM2ENTRY(Vma, vmaTag, node);
+}
+
+static inline uintptr_t Vma_End(const Vma *vma)
+{
+    return vma->start + vma->len;
+}
+
+/* 虚拟内存区域模块初始化 */
+void Vma_Init(void)
+{
+    put_str("Vma_Init start. \n");
+
+    g_vmaCache = Slab_CacheCreate("vma", sizeof(Vma), NULL);
+    ASSERT(g_vmaCache != NULL);
+
+    put_str("Vma_Init end. \n");
+}
+
+/* 初始化空的用户虚拟地址空间 */
+void Vma_SpaceInit(VmaSpace *space)
+{
+    List_Init(&space->vmaList);
+    space->vmaCnt = 0;
+}
+
+/* 创建区域描述符并插入到before节点之前 */
+static Vma *Vma_New(VmaSpace *space, ListNode *before, uintptr_t start, uint32_t len, uint32_t flags)
+{
+    Vma *vma = Slab_Alloc(g_vmaCache);
+    if (vma == NULL) {
+        return NULL;
+    }
+
+    vma->start = start;
+    vma->len = len;
+    vma->flags = flags;
+    List_InsertBefore(before, &vma->vmaTag);
+    space->vmaCnt++;
+
+    return vma;
+}
+
+/* 从地址空间中摘除并释放区域描述符 */
+static void Vma_Delete(VmaSpace *space, Vma *vma)
+{
+    List_Remove(&vma->vmaTag);
+    space->vmaCnt--;
+    Slab_Free(g_vmaCache, vma);
+}
+
+/* 释放地址空间中的全部区域描述符 */
+void Vma_SpaceRelease(VmaSpace *space)
+{
+    while (!List_IsEmpty(&space->vmaList)) {
+        Vma_Delete(space, Vma_Entry(space->vmaList.head.next));
+    }
+}
+
+/* 在before节点之前加入区域[start, start + len)，与相邻且标志相同的区域合并 */
+static int32_t Vma_Link(VmaSpace *space, ListNode *before, uintptr_t start, uint32_t len, uint32_t flags)
+{
+    Vma *prev = (before->prev != &space->vmaList.head) ? Vma_Entry(before->prev) : NULL;
+    Vma *next = (before != &space->vmaList.tail) ? Vma_Entry(before) : NULL;
+    bool mergePrev = (prev != NULL) && (Vma_End(prev) == start) && (prev->flags == flags);
+    bool mergeNext = (next != NULL) && (start + len == next->start) && (next->flags == flags);
+
+    if (mergePrev && mergeNext) {
+        prev->len += len + next->len;
+        Vma_Delete(space, next);
+    } else if (mergePrev) {
+        prev->len += len;
+    } else if (mergeNext) {
+        next->start = start;
+        next->len += len;
+    } else if (Vma_New(space, before, start, len, flags) == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* 在[USER_VADDR_START, USER_VADDR_STACK)中找到长度为len的空闲地址并预留，失败返回NULL */
+uintptr_t Vma_Alloc(VmaSpace *space, uint32_t len, uint32_t flags)
+{
+    ASSERT((len > 0) && ((len & 0x00000fff) == 0));
+
+    /* 首次适配：依次检查各区域之前的空隙 */
+    uintptr_t gapStart = USER_VADDR_START;
+    ListNode *node = space->vmaList.head.next;
+    while (node != &space->vmaList.tail) {
+        Vma *vma = Vma_Entry(node);
+        if ((vma->start >= gapStart) && (vma->start - gapStart >= len)) {
+            break;
+        }
+        if (Vma_End(vma) > gapStart) {
+            gapStart = Vma_End(vma);
+        }
+        node = node->next;
+    }
+
+    uintptr_t gapEnd = (node != &space->vmaList.tail) ? Vma_Entry(node)->start : USER_VADDR_STACK;
+    if ((gapStart > gapEnd) || (gapEnd - gapStart < len)) {
+        return NULL;
+    }
+
+    if (Vma_Link(space, node, gapStart, len, flags) == -1) {
+        return NULL;
+    }
+
+    return gapStart;
+}
+
+/* 预留指定地址[start, start + len)，与已有区域重叠时返回-1 */
+int32_t Vma_Insert(VmaSpace *space, uintptr_t start, uint32_t len, uint32_t flags)
+{
+    ASSERT((len > 0) && (start + len > start));
+
+    ListNode *node = space->vmaList.head.next;
+    while ((node != &space->vmaList.tail) && (Vma_Entry(node)->start < start)) {
+        node = node->next;
+    }
+
+    if ((node->prev != &space->vmaList.head) && (Vma_End(Vma_Entry(node->prev)) > start)) {
+        return -1;
+    }
+    if ((node != &space->vmaList.tail) && (Vma_Entry(node)->start < start + len)) {
+        return -1;
+    }
+
+    return Vma_Link(space, node, start, len, flags);
+}
+
+/* 取消预留[start, start + len)，必要时拆分区域，失败返回-1 */
+int32_t Vma_Remove(VmaSpace *space, uintptr_t start, uint32_t len)
+{
+    uintptr_t end = start + len;
+    ListNode *node = space->vmaList.head.next;
+    while (node != &space->vmaList.tail) {
+        Vma *vma = Vma_Entry(node);
+        ListNode *next = node->next;
+        uintptr_t vmaEnd = Vma_End(vma);
+
+        if (vma->start >= end) {
+            break;
+        }
+
+        if (vmaEnd > start) {
+            if ((vma->start < start) && (vmaEnd > end)) {
+                /* 从区域中间挖掉一段，拆分为两个区域 */
+                if (Vma_New(space, next, end, vmaEnd - end, vma->flags) == NULL) {
+                    return -1;
+                }
+                vma->len = start - vma->start;
+                break;
+            } else if (vma->start < start) {
+                vma->len = start - vma->start;
+            } else if (vmaEnd > end) {
+                vma->start = end;
+                vma->len = vmaEnd - end;
+            } else {
+                Vma_Delete(space, vma);
+            }
+        }
+
+        node = next;
+    }
+
+    return 0;
+}
+
+/* 查找包含地址addr的区域，不存在返回NULL */
+Vma *Vma_Find(VmaSpace *space, uintptr_t addr)
+{
+    ListNode *node = space->vmaList.head.next;
+    while (node != &space->vmaList.tail) {
+        Vma *vma = Vma_Entry(node);
+        if (addr < vma->start) {
+            break;
+        }
+        if (addr < Vma_End(vma)) {
+            return vma;
+        }
+        node = node->next;
+    }
+
+    return NULL;
+}
+
+/* 复制地址空间的全部区域，失败返回-1 */
+int32_t Vma_Copy(VmaSpace *dst, const VmaSpace *src)
+{
+    Vma_SpaceInit(dst);
+
+    const ListNode *node = src->vmaList.head.next;
+    while (node != &src->vmaList.tail) {
+        const Vma *vma = Vma_Entry(node);
+        if (Vma_New(dst, &dst->vmaList.tail, vma->start, vma->len, vma->flags) == NULL) {
+            Vma_SpaceRelease(dst);
+            return -1;
+        }
+        node = node->next;
+    }
+
+    return 0;
+}
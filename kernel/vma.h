@@ -0,0 +1,52 @@
+/*
+ *  kernel/vma.h
+ *
+ *  (C) 2021  Jacky
+ */
+#ifndef VMA_H
+#define VMA_H
+
+#include "stdint.h"
+#include "lib/list.h"
+
+/* 虚拟内存区域标志 */
+#define VMA_HEAP  0x01    /* 堆及Mem_MallocPages分配的区域 */
+#define VMA_STACK 0x02    /* 用户栈 */
+#define VMA_FIXED 0x04    /* 在指定地址映射的区域，如进程体 */
+#define VMA_BRK   0x08    /* brk堆，从USER_BRK_START向上增长 */
+#define VMA_MMAP  0x10    /* mmap建立的匿名映射 */
+
+/* 虚拟内存区域，描述一段已预留的用户虚拟地址[start, start + len) */
+typedef struct {
+    /* 在VmaSpace有序链表中的节点 */
+    ListNode vmaTag;
+    uintptr_t start;
+    uint32_t len;
+    uint32_t flags;
+} Vma;
+
+/* 进程的用户虚拟地址空间，按起始地址排序且互不重叠的区域链表 */
+typedef struct {
+    List vmaList;
+    /* 区域个数 */
+    uint32_t vmaCnt;
+} VmaSpace;
+
+/* 虚拟内存区域模块初始化 */
+void Vma_Init(void);
+/* 初始化空的用户虚拟地址空间 */
+void Vma_SpaceInit(VmaSpace *space);
+/* 释放地址空间中的全部区域描述符 */
+void Vma_SpaceRelease(VmaSpace *space);
+/* 在[USER_VADDR_START, USER_VADDR_STACK)中找到长度为len的空闲地址并预留，失败返回NULL */
+uintptr_t Vma_Alloc(VmaSpace *space, uint32_t len, uint32_t flags);
+/* 预留指定地址[start, start + len)，与已有区域重叠时返回-1 */
+int32_t Vma_Insert(VmaSpace *space, uintptr_t start, uint32_t len, uint32_t flags);
+/* 取消预留[start, start + len)，必要时拆分区域，失败返回-1 */
+int32_t Vma_Remove(VmaSpace *space, uintptr_t start, uint32_t len);
+/* 查找包含地址addr的区域，不存在返回NULL */
+Vma *Vma_Find(VmaSpace *space, uintptr_t addr);
+/* 复制地址空间的全部区域，失败返回-1 */
+int32_t Vma_Copy(VmaSpace *dst, const VmaSpace *src);
+
+#endif
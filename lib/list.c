@@ -16,6 +16,22 @@ void List_Init(List *list)
     list->head.next = &(list->tail);
     list->tail.prev = &(list->head);
     list->tail.next = NULL;
+#ifdef LIST_OWNER_CHECK
+    list->head.owner = list;
+    list->tail.owner = list;
+#endif
+
+    return;
+}
+
+/* 节点初始化，未经此初始化且从未入链的节点不能用于List_Find */
+void List_NodeInit(ListNode *listNode)
+{
+    listNode->prev = NULL;
+    listNode->next = NULL;
+#ifdef LIST_OWNER_CHECK
+    listNode->owner = NULL;
+#endif
 
     return;
 }
@@ -35,6 +51,9 @@ void List_Push(List *list, ListNode *listNode)
     
     list->head.prev = NULL;
     list->head.next = listNode;
+#ifdef LIST_OWNER_CHECK
+    listNode->owner = list;
+#endif
 
     /* 处理完成后需要打开中断 */
     Idt_SetIntrStatus(status);
@@ -57,6 +76,33 @@ void List_Append(List *list, ListNode *listNode)
     
     list->tail.prev = listNode;
     list->tail.next = NULL;
+#ifdef LIST_OWNER_CHECK
+    listNode->owner = list;
+#endif
+
+    /* 处理完成后需要打开中断 */
+    Idt_SetIntrStatus(status);
+
+    return;
+}
+
+/* 在before节点之前插入一个节点 */
+void List_InsertBefore(ListNode *before, ListNode *listNode)
+{
+    ASSERT((before != NULL) && (listNode != NULL));
+
+    /* 链表为全局的，需要关中断保护 */
+    IntrStatus status = Idt_IntrDisable();
+
+    before->prev->next = listNode;
+
+    listNode->prev = before->prev;
+    listNode->next = before;
+
+    before->prev = listNode;
+#ifdef LIST_OWNER_CHECK
+    listNode->owner = before->owner;
+#endif
 
     /* 处理完成后需要打开中断 */
     Idt_SetIntrStatus(status);
@@ -72,6 +118,9 @@ void List_Remove(ListNode *listNode)
 
     listNode->prev->next = listNode->next;
     listNode->next->prev = listNode->prev;
+#ifdef LIST_OWNER_CHECK
+    listNode->owner = NULL;
+#endif
     
     /* 处理完成后需要打开中断 */
     Idt_SetIntrStatus(status);
@@ -102,6 +151,9 @@ ListNode *List_Pop(List *list)
 
     listNode->prev->next = listNode->next;
     listNode->next->prev = listNode->prev;
+#ifdef LIST_OWNER_CHECK
+    listNode->owner = NULL;
+#endif
 
     /* 处理完成后需要打开中断 */
     Idt_SetIntrStatus(status);
@@ -109,11 +161,14 @@ ListNode *List_Pop(List *list)
     return listNode;
 }
 
-/* 在链表中查找节点 */
+/* 在链表中查找节点，维护所属链表时为O(1) */
 bool List_Find(const List *list, const ListNode *listNode)
 {
     ASSERT((list != NULL) && (listNode != NULL));
 
+#ifdef LIST_OWNER_CHECK
+    return listNode->owner == list;
+#else
     const ListNode *listNodeTmp = list->head.next;
 
     while (listNodeTmp != &(list->tail)) {
@@ -124,6 +179,7 @@ bool List_Find(const List *list, const ListNode *listNode)
     }
 
     return false;
+#endif
 }
 
 /* 遍历链表节点，对链表节点执行func(node)操作 */
@@ -8,18 +8,27 @@
 
 #include "stdint.h"
 
+/* ASSERT生效时(未定义DEBUG_KERNEL)维护节点所属的链表，链表成员检查为O(1) */
+#ifndef DEBUG_KERNEL
+#define LIST_OWNER_CHECK
+#endif
+
 typedef struct _ListNode {
     struct _ListNode *prev;
     struct _ListNode *next;
+#ifdef LIST_OWNER_CHECK
+    /* 节点所在的链表，不在链表中时为NULL */
+    struct _List *owner;
+#endif
 } ListNode;
 
-typedef struct {
+typedef struct _List {
     struct _ListNode head;
     struct _ListNode tail;
 } List;
 
 /* 结构体成员的偏移值 */
-#define OFFSET(struct_name, member) (int32_t)(&((struct_name *)0)->member)
+#define OFFSET(struct_name, member) (int32_t)(uintptr_t)(&((struct_name *)0)->member)
 /* 通过链接节点获取对应的结构体空间 */
 #define ELEM2ENTRY(struct_name, member, elem_ptr) \
     (struct_name *)((uintptr_t)elem_ptr - OFFSET(struct_name, member))
@@ -28,17 +37,21 @@ typedef void (*Func) (ListNode *, void *);
 
 /* 链表初始化 */
 void List_Init(List *list);
+/* 节点初始化，未经此初始化且从未入链的节点不能用于List_Find */
+void List_NodeInit(ListNode *listNode);
 /* 在头部插入一个节点 */
 void List_Push(List *list, ListNode *listNode);
 /* 在尾部插入一个节点 */
 void List_Append(List *list, ListNode *listNode);
+/* 在before节点之前插入一个节点 */
+void List_InsertBefore(ListNode *before, ListNode *listNode);
 /* 在链表中删除一个节点 */
 void List_Remove(ListNode *listNode);
 /* 判断是否为空链表 */
 bool List_IsEmpty(List *list);
 /* 从链表头弹出一个节点 */
 ListNode *List_Pop(List *list);
-/* 在链表中查找节点 */
+/* 在链表中查找节点，维护所属链表时为O(1) */
 bool List_Find(const List *list, const ListNode *listNode);
 /* 遍历链表节点，对链表节点执行func(node)操作 */
 void List_Traversal(List *list, Func func, void *arg);
@@ -0,0 +1,162 @@
+/*
+ *  lib/umalloc.c
+ *
+ *  (C) 2021  Jacky
+ */
+
+#include "umalloc.h"
+#include "stdint.h"
+#include "kernel/syscall.h"
+#include "kernel/process.h"
+
+/* 用户态内存分配器：小块按规格从brk区切分并缓存在线程缓存中，大块直接使用匿名映射
+ * 只有补充缓存时扩展brk区和大块的分配释放才会进入内核
+ */
+
+/* 分配器状态位于各进程私有的brk堆首页，fork后子进程得到自己的一份 */
+static inline UMallocHeap *UMalloc_Heap(void)
+{
+    return (UMallocHeap *)USER_BRK_START;
+}
+
+/* 返回能容纳size字节（含块头）的最小规格下标 */
+static inline uint32_t UMalloc_ClassIdx(uint32_t size)
+{
+    uint32_t idx = 0;
+    while ((UMALLOC_MIN_SIZE << idx) < size) {
+        idx++;
+    }
+
+    return idx;
+}
+
+/* 从brk区切分一个块，剩余空间不足时先扩展brk区，失败返回NULL */
+static void *UMalloc_Carve(UMallocHeap *heap, uint32_t blockSize)
+{
+    if (heap->arenaEnd - heap->arenaCur < blockSize) {
+        uint8_t *chunk = sbrk(UMALLOC_GROW);
+        if (chunk == (void *)-1) {
+            return NULL;
+        }
+
+        /* break被其他代码移动过时，放弃旧区间的剩余部分 */
+        if ((uintptr_t)chunk != heap->arenaEnd) {
+            heap->arenaCur = (uintptr_t)chunk;
+        }
+        heap->arenaEnd = (uintptr_t)chunk + UMALLOC_GROW;
+    }
+
+    void *block = (void *)heap->arenaCur;
+    heap->arenaCur += blockSize;
+
+    return block;
+}
+
+/* 线程缓存为空时补充一批空闲块，先从中心空闲链表取，不足时从brk区切分 */
+static bool UMalloc_Refill(UMallocHeap *heap, uint32_t idx)
+{
+    UMallocCache *cache = &heap->cache;
+    for (uint32_t i = 0; i < UMALLOC_BATCH; i++) {
+        void *block = heap->freeList[idx];
+        if (block != NULL) {
+            heap->freeList[idx] = *(void **)block;
+            heap->freeCnt[idx]--;
+        } else {
+            block = UMalloc_Carve(heap, UMALLOC_MIN_SIZE << idx);
+            if (block == NULL) {
+                break;
+            }
+        }
+
+        *(void **)block = cache->freeList[idx];
+        cache->freeList[idx] = block;
+        cache->freeCnt[idx]++;
+    }
+
+    return cache->freeList[idx] != NULL;
+}
+
+/* 线程缓存超出上限时，退回一批空闲块给中心空闲链表 */
+static void UMalloc_Drain(UMallocHeap *heap, uint32_t idx)
+{
+    UMallocCache *cache = &heap->cache;
+    for (uint32_t i = 0; i < UMALLOC_BATCH; i++) {
+        void *block = cache->freeList[idx];
+        cache->freeList[idx] = *(void **)block;
+        cache->freeCnt[idx]--;
+
+        *(void **)block = heap->freeList[idx];
+        heap->freeList[idx] = block;
+        heap->freeCnt[idx]++;
+    }
+}
+
+/* 用户态申请size字节内存，失败返回NULL */
+void *umalloc(uint32_t size)
+{
+    if ((size == 0) || (size > 0xffffffff - sizeof(UMallocHdr))) {
+        return NULL;
+    }
+
+    UMallocHdr *hdr = NULL;
+    uint32_t blockSize = size + sizeof(UMallocHdr);
+    if (blockSize > UMALLOC_MAX_SIZE) {
+        /* 大块单独建立匿名映射，释放时立即归还内核 */
+        hdr = mmap(NULL, blockSize, MAP_PRIVATE | MAP_ANONYMOUS);
+        if (hdr == MAP_FAILED) {
+            return NULL;
+        }
+        hdr->size = blockSize;
+        hdr->classIdx = UMALLOC_LARGE;
+        return hdr + 1;
+    }
+
+    UMallocHeap *heap = UMalloc_Heap();
+    UMallocCache *cache = &heap->cache;
+    uint32_t idx = UMalloc_ClassIdx(blockSize);
+    if (cache->freeList[idx] != NULL) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+        if (!UMalloc_Refill(heap, idx)) {
+            return NULL;
+        }
+    }
+
+    hdr = cache->freeList[idx];
+    cache->freeList[idx] = *(void **)hdr;
+    cache->freeCnt[idx]--;
+
+    hdr->size = UMALLOC_MIN_SIZE << idx;
+    hdr->classIdx = idx;
+
+    return hdr + 1;
+}
+
+/* 释放umalloc申请的内存 */
+void ufree(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    UMallocHdr *hdr = (UMallocHdr *)ptr - 1;
+    if (hdr->classIdx == UMALLOC_LARGE) {
+        munmap(hdr, hdr->size);
+        return;
+    }
+
+    UMallocHeap *heap = UMalloc_Heap();
+    UMallocCache *cache = &heap->cache;
+    uint32_t idx = hdr->classIdx;
+
+    *(void **)hdr = cache->freeList[idx];
+    cache->freeList[idx] = hdr;
+    cache->freeCnt[idx]++;
+
+    if (cache->freeCnt[idx] > UMALLOC_CACHE_MAX) {
+        UMalloc_Drain(heap, idx);
+    }
+
+    return;
+}
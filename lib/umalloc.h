@@ -0,0 +1,58 @@
+/*
+ *  lib/umalloc.h
+ *
+ *  (C) 2021  Jacky
+ */
+#ifndef UMALLOC_H
+#define UMALLOC_H
+
+#include "stdint.h"
+
+/* 小内存块规格数，块大小（含块头）依次为16、32、...、2048字节 */
+#define UMALLOC_CLASS_CNT  8
+#define UMALLOC_MIN_SIZE   16U
+#define UMALLOC_MAX_SIZE   (UMALLOC_MIN_SIZE << (UMALLOC_CLASS_CNT - 1))
+/* 线程缓存每个规格最多保留的空闲块数，超出时退回一批给中心空闲链表 */
+#define UMALLOC_CACHE_MAX  64
+/* 线程缓存与中心空闲链表之间每次转移的块数 */
+#define UMALLOC_BATCH      16
+/* brk区不足时每次扩展的字节数 */
+#define UMALLOC_GROW       (64 * 1024)
+
+/* 块头，位于返回给用户的地址之前 */
+typedef struct {
+    /* 块大小，大块为映射长度 */
+    uint32_t size;
+    /* 规格下标，大块为UMALLOC_LARGE */
+    uint32_t classIdx;
+} UMallocHdr;
+
+#define UMALLOC_LARGE 0xffffffff
+
+/* 线程缓存，空闲块单链表的链接指针存放在块的首4字节 */
+typedef struct {
+    void *freeList[UMALLOC_CLASS_CNT];
+    uint32_t freeCnt[UMALLOC_CLASS_CNT];
+    /* 命中缓存和需要补充的次数 */
+    uint32_t hits;
+    uint32_t misses;
+} UMallocCache;
+
+/* 分配器状态，存放在内核为每个进程预留的brk堆首页，首次访问时为全0 */
+typedef struct {
+    /* 中心空闲链表，存放线程缓存退回的块 */
+    void *freeList[UMALLOC_CLASS_CNT];
+    uint32_t freeCnt[UMALLOC_CLASS_CNT];
+    /* brk区中尚未切分的部分[arenaCur, arenaEnd) */
+    uintptr_t arenaCur;
+    uintptr_t arenaEnd;
+    /* 进程目前只有一个线程，只需一个线程缓存 */
+    UMallocCache cache;
+} UMallocHeap;
+
+/* 用户态申请size字节内存，失败返回NULL */
+void *umalloc(uint32_t size);
+/* 释放umalloc申请的内存 */
+void ufree(void *ptr);
+
+#endif
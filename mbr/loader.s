@@ -32,7 +32,9 @@ total_mem_bytes dd 0
 gdt_ptr dw GDT_LIMIT
         dd GDT_BASE
 
-; ards预留244字节空间，用于获取物理内存大小时使用
+; ards预留244字节空间，用于获取物理内存大小时使用，最多存放12个ards结构体
+; 内核按固定地址读取ards_buf和ards_nr，获取完整的物理内存布局
+ARDS_MAX equ 12
 ards_buf times 244 db 0
 ards_nr dw 0
 
@@ -59,8 +61,11 @@ loader_start:
     jc .e820_get_mem_fail_and_try_e801  ; 如果利用e820获取失败，则改用e801
     add di, cx                 ; 指向下一个缓冲区
     inc word [ards_nr]         ; 记录获取到的ards数量
+    cmp word [ards_nr], ARDS_MAX ; 缓冲区已满，丢弃剩余的结构体
+    je .e820_mem_get_done
     cmp ebx, 0                 ; 如果ebx为0，表示获取到最后一个结构体
     jnz .e820_mem_get_loop
+.e820_mem_get_done:
 ; 在所有结构体中，找出最大的一组，这个总物理内存容量
     mov cx, [ards_nr]
     mov ebx, ards_buf
@@ -71,7 +76,7 @@ loader_start:
     add eax, [ebx + 8]        ; length_low
     add ebx, 20               ; 指向下一个缓冲区
     cmp edx, eax
-    jge .next_ards
+    jae .next_ards            ; 按无符号数比较，支持2G以上内存
     mov edx, eax              ; 如果比当前记录最大内存要大，则保存
 
 .next_ards:
@@ -80,6 +85,7 @@ loader_start:
 
 ; e820获取失败，改成e801
 .e820_get_mem_fail_and_try_e801:
+    mov word [ards_nr], 0      ; ards不完整，内核改用total_mem_bytes
     mov ax, 0xe801
     int 0x15
     jc .e801_get_mem_fail_and_try_88
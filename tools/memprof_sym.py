@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+#
+#  tools/memprof_sym.py
+#
+#  (C) 2021  Jacky
+#
+# 将MemProf_Dump输出中的调用点地址对照kernel.map解析为“函数+偏移”
+# 用法：python3 tools/memprof_sym.py output/kernel.map < console.log
+
+import bisect
+import re
+import sys
+
+# ld -Map生成的符号行：地址 + 符号名
+SYMBOL_LINE = re.compile(r'^\s+0x([0-9a-fA-F]+)\s+([A-Za-z_][A-Za-z0-9_]*)\s*$')
+# MemProf_Dump打印的调用点行
+SITE_LINE = re.compile(r'memprof site 0x([0-9a-fA-F]+)')
+
+
+def load_symbols(map_path):
+    symbols = []
+    with open(map_path) as map_file:
+        for line in map_file:
+            match = SYMBOL_LINE.match(line)
+            if match:
+                symbols.append((int(match.group(1), 16), match.group(2)))
+    symbols.sort()
+    return symbols
+
+
+def resolve(symbols, addrs, addr):
+    idx = bisect.bisect_right(addrs, addr) - 1
+    if idx < 0:
+        return '0x%x' % addr
+    base, name = symbols[idx]
+    return '%s+0x%x' % (name, addr - base)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write('usage: %s kernel.map < dump\n' % sys.argv[0])
+        return 1
+
+    symbols = load_symbols(sys.argv[1])
+    addrs = [addr for addr, _ in symbols]
+    for line in sys.stdin:
+        match = SITE_LINE.search(line)
+        if match:
+            addr = int(match.group(1), 16)
+            line = line.replace(match.group(0), 'memprof site %s' % resolve(symbols, addrs, addr), 1)
+        sys.stdout.write(line)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())